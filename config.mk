@@ -86,14 +86,18 @@ misbehave misbehave_wrap cvar_test thr_exit_join
 # A list of the test programs you want compiled in from the user/progs
 # directory
 #
-STUDENTTESTS =   
+STUDENTTESTS = bench_thread bench_mutex bench_cond bench_sem bench_rwlock \
+bench_malloc bench_autostack bench_barrier bench_channel bench_tpool \
+bench_future bench_fiber
 
 ###########################################################################
 # Object files for your thread library
 ###########################################################################
-THREAD_OBJS = malloc.o panic.o cond_variable.o hashtable.o linklist.o \
-mutex.o thr_internals.o thread.o atom_xchg.o sem.o get_thread_from_stack.o \
-rwlock.o
+THREAD_OBJS = malloc.o panic.o cond_variable.o registry.o linklist.o \
+mutex.o thr_internals.o thread.o atom_xchg.o sem.o \
+rwlock.o atom_cmpxchg.o waitqueue.o atom_cmpxchg64.o vanish_release.o \
+atom_add.o pool.o arena.o seqlock.o barrier.o channel.o tpool.o future.o fiber.o \
+fiber_switch.o
 
 # Thread Group Library Support.
 #
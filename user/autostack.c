@@ -18,10 +18,11 @@
 #define PAGE_ALIGN_MASK ((unsigned int) ~((unsigned int) (PAGE_SIZE-1)))
 #define ROOT_HDLR_STACK 0x011FFFFF
 
-static int g_root_tid;
 static void excpetion_handler(void *, ureg_t *);
 static int root_stack_extend(void *);
 static int thread_stack_extend(void *, thread_t *);
+static int stack_grow_size(thr_stack_policy_t *, int *, unsigned int, 
+                           unsigned int);
 
 void install_autostack(void *stack_high, void *stack_low)
 {
@@ -32,32 +33,38 @@ void install_autostack(void *stack_high, void *stack_low)
     g_stackinfo.rootstack_low = stack_low;
     g_stackinfo.rootstack_hi = stack_high;
     g_stackinfo.max_stacksize = (int)stack_high - ROOT_HDLR_STACK;
-    g_root_tid = gettid();
 
     /* space for the stack of root thread */
     if (0 > new_pages((void *)(ROOT_HDLR_STACK - PAGE_SIZE + 1), PAGE_SIZE))
         thr_exit((void *)-1);
 
     /* register a exception handler */
-    register_exception_handler((void *)ROOT_HDLR_STACK + 1, NULL);
+    register_exception_handler((void *)ROOT_HDLR_STACK + 1, NULL, NULL);
 
     return;
 }
 
-void register_exception_handler(void *stackbase, ureg_t *ureg)
+/* 
+ * The context is handed back to the handler by swexn, so the handler knows
+ * its thread without gettid() or any lookup.
+ */
+void register_exception_handler(void *stackbase, void *context, ureg_t *ureg)
 {
-    swexn(stackbase, excpetion_handler, NULL, ureg);
+    swexn(stackbase, excpetion_handler, context, ureg);
 
     return;
 }
 
+/* 
+ * Take no lock here: the faulting thread may hold any library lock. The 
+ * thread structure is only changed by its own thread.
+ */
 void excpetion_handler(void *arg, ureg_t *ureg)
 {
     void *faultaddr = NULL;
     void *phdlrstack = NULL;
     int ret = ERROR;
-    thread_t *pthread = NULL;
-    int tid = gettid();
+    thread_t *pthread = (thread_t *)arg;
     
     /* if something rather than page fault */
     if ((NULL == ureg) || (SWEXN_CAUSE_PAGEFAULT != ureg->cause) ||
@@ -67,16 +74,12 @@ void excpetion_handler(void *arg, ureg_t *ureg)
     /* get the fault address */
     faultaddr = (void *)ureg->cr2;
 
-    if (g_root_tid == tid) {
+    if (NULL == pthread) {
         phdlrstack = (void *)ROOT_HDLR_STACK + 1;
         
         /* root thread extends stack */
         ret = root_stack_extend(faultaddr);             
     } else {
-        /* get the thread from hash table */
-        pthread = get_thread_by_tid(tid);
-        if (NULL == pthread)
-            thr_exit((void *)-1);
         phdlrstack = pthread->stack_base + 1;
         
         /* other threads extend stack */
@@ -85,12 +88,12 @@ void excpetion_handler(void *arg, ureg_t *ureg)
    
     /* no more space to extend, terminate this thread */
     if (OK != ret) {
-        lprintf("+++++++++++++ tid%d ret err++++++++++++\n", tid);
+        lprintf("+++++++++++++ %p ret err++++++++++++\n", faultaddr);
         thr_exit((void *)-1);
     }
     
     /* re install handler */
-    register_exception_handler(phdlrstack, ureg);
+    register_exception_handler(phdlrstack, pthread, ureg);
     
     return;
 }
@@ -100,16 +103,36 @@ int root_stack_extend(void *faultaddr)
     void *pagebase = NULL;
     int extendsize = 0;
     thread_t *pthread = NULL;
-
-    lprintf("%d in root_stack_extend\n", gettid());
+    thr_stack_policy_t *policy = get_stack_policy();
+    int *plastgrow = &g_stackinfo.root_last_grow;
+    int *pfaults = &g_stackinfo.root_faults;
+    unsigned int room = 0;
 
     /* faul address is out of the range of stack extension */
     if ((faultaddr >= g_stackinfo.rootstack_low) || 
         (faultaddr <= (g_stackinfo.rootstack_hi - g_stackinfo.max_stacksize)))
         return ERROR;
 
+    /* the root thread structure has the policy after thr_init */
+    if (LIB_IS_INIT == g_stackinfo.is_init) {
+        pthread = (thread_t *)g_stackinfo.root_thread;
+        policy = &pthread->stack_policy;
+        plastgrow = &pthread->last_grow;
+        pfaults = &pthread->stack_faults;
+    }
+
     pagebase = (void *)((unsigned int)faultaddr & PAGE_ALIGN_MASK);
-    extendsize = (int)(g_stackinfo.rootstack_low - pagebase);
+    room = (unsigned int)(g_stackinfo.rootstack_low - 
+           (g_stackinfo.rootstack_hi - g_stackinfo.max_stacksize + 1));
+
+    /* the last region to record takes all the room */
+    if ((NULL != pthread) && 
+        (pthread->stack_nregions >= STACK_REGION_MAX - 1))
+        pagebase = g_stackinfo.rootstack_low - room;
+
+    extendsize = stack_grow_size(policy, plastgrow, 
+        (unsigned int)(g_stackinfo.rootstack_low - pagebase), room);
+    pagebase = g_stackinfo.rootstack_low - extendsize;
 
     /* new_page for thread stack */
     if(0 > new_pages(pagebase, extendsize))
@@ -117,17 +140,16 @@ int root_stack_extend(void *faultaddr)
 
     /* update thread info */
     g_stackinfo.rootstack_low = pagebase;
+    (*pfaults)++;
 
     /* 
      * also record in root thread structure because root may terminate and this
      * stack sapce can be used again
      */
-    if (LIB_IS_INIT == g_stackinfo.is_init) {
-        pthread = get_thread_by_tid(g_root_tid);
-        if (NULL == pthread)
-            return ERROR;
+    if (NULL != pthread) {
         pthread->stack_size = g_stackinfo.rootstack_hi - 
                               g_stackinfo.rootstack_low;
+        record_stack_region(pthread, extendsize);
     }
     
     return OK;
@@ -137,6 +159,7 @@ int thread_stack_extend(void *faultaddr, thread_t *pthread)
 {
     void *pagebase = NULL;
     int extendsize = 0;
+    unsigned int room = 0;
     
     /* faul address is out of the range of stack extension */
     if ((faultaddr > (pthread->stack_base - pthread->stack_size)) ||
@@ -146,8 +169,18 @@ int thread_stack_extend(void *faultaddr, thread_t *pthread)
     }
 
     pagebase = (void *)((unsigned int)faultaddr & PAGE_ALIGN_MASK);
-    extendsize = (int)((char *)pthread->stack_base - pthread->stack_size
-                       + 1 - (char *)pagebase);
+    room = g_stackinfo.max_stacksize - pthread->stack_size;
+
+    /* the last region to record takes all the room */
+    if (pthread->stack_nregions >= STACK_REGION_MAX - 1)
+        pagebase = (char *)pthread->stack_base - pthread->stack_size + 1 - 
+                   room;
+
+    extendsize = stack_grow_size(&pthread->stack_policy, &pthread->last_grow,
+        (unsigned int)((char *)pthread->stack_base - pthread->stack_size + 
+                       1 - (char *)pagebase), room);
+    pagebase = (char *)pthread->stack_base - pthread->stack_size + 1 - 
+               extendsize;
 
     /* new_page for thread stack */
     if(0 > new_pages(pagebase, extendsize)) 
@@ -155,6 +188,35 @@ int thread_stack_extend(void *faultaddr, thread_t *pthread)
     
     /* update thread info */
     pthread->stack_size += extendsize;
+    pthread->stack_faults++;
+    record_stack_region(pthread, extendsize);
 
     return OK;
 }
+
+/* 
+ * Bytes to grow a stack by: at least up to the faulting page (need), more 
+ * if the policy asks, but never over the max stack size (room). The root
+ * stack may have more room than an int can hold before thr_init.
+ */
+int stack_grow_size(thr_stack_policy_t *policy, int *plastgrow, 
+                    unsigned int need, unsigned int room)
+{
+    unsigned int size = policy->chunk_pages * PAGE_SIZE;
+
+    /* double the last growth, up to the cap */
+    if ((THR_STACK_GROW_DOUBLE == policy->policy) && (*plastgrow > 0)) {
+        size = *plastgrow * 2;
+        if ((0 < policy->max_chunk_pages) && 
+            (size > (unsigned int)policy->max_chunk_pages * PAGE_SIZE))
+            size = policy->max_chunk_pages * PAGE_SIZE;
+    }
+
+    if (size < need)
+        size = need;
+    if (size > room)
+        size = room;
+
+    *plastgrow = size;
+    return size;
+}
@@ -0,0 +1,48 @@
+/** @file arena.h
+ *  @brief The .h file of the arena allocator.
+ *
+ *  An arena allocates by bumping a pointer in its current chunk, without
+ *  any lock, and frees everything at once. Chunks are large blocks of
+ *  malloc(), so they come straight from new_pages(). An arena is used by
+ *  one thread at a time.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _ARENA_H
+#define _ARENA_H
+
+/* Default chunk size */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/* Flags of arena_create() */
+#define ARENA_BIND_THREAD 1  /* destroyed when the calling thread exits */
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;   /* older chunk */
+    int size;                   /* bytes of the chunk, keeps it 8-byte long */
+} arena_chunk_t;
+
+typedef struct arena {
+    arena_chunk_t *chunks;  /* current chunk first */
+    char *ptr;              /* next free byte of the current chunk */
+    char *end;              /* end of the current chunk */
+    int chunk_size;         /* size of a new chunk */
+    void *owner;            /* bound thread, NULL if not bound */
+    struct arena *next;     /* next arena bound to the thread */
+} arena_t;
+
+/* create an arena, chunk_size 0 for ARENA_CHUNK_SIZE */
+arena_t *arena_create(int chunk_size, int flags);
+
+/* allocate size bytes, 8-byte aligned */
+void *arena_alloc(arena_t *arena, int size);
+
+/* free everything allocated, keep the current chunk */
+void arena_reset(arena_t *arena);
+
+/* free the arena, only by the bound thread if it is bound */
+void arena_destroy(arena_t *arena);
+
+#endif /* _ARENA_H */
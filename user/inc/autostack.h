@@ -17,11 +17,18 @@ typedef struct {
     void *rootstack_hi;
     int max_stacksize;
     int is_init;
+    void *root_thread;  /* root thread structure, set by thread library */
+    int root_last_grow; /* root stack growth before thread library init */
+    int root_faults;
 } stackinfo_t;
 
 /* root stack information, modified by thread library */
 stackinfo_t g_stackinfo;
 
-void register_exception_handler(void *, ureg_t *);
+/* 
+ * Register the handler on an exception stack. The context is the thread 
+ * structure of the thread, NULL for the root thread. 
+ */
+void register_exception_handler(void *, void *, ureg_t *);
 
 #endif /* _AUTOSTACK_H */
@@ -0,0 +1,36 @@
+/** @file barrier.h
+ *  @brief The .h file of the barrier.
+ *
+ *  A barrier holds the threads calling barrier_wait() until n of them have
+ *  arrived, then lets all of them go and starts over for the next phase.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _BARRIER_H
+#define _BARRIER_H
+
+#include <linklist.h>
+
+/* returned by barrier_wait() to the last thread of a phase */
+#define BARRIER_SERIAL_THREAD 1
+
+typedef struct barrier {
+    int n;                  /* threads of a phase */
+    int count;              /* threads arrived in this phase */
+    volatile int sense;     /* flipped when a phase is over */
+    int qlock;              /* protect waitqueue */
+    linklist_t waitqueue;   /* threads parked in this phase */
+} barrier_t;
+
+/* initialize a barrier for n threads */
+int barrier_init(barrier_t *barrier, int n);
+
+/* wait for the other threads of the phase */
+int barrier_wait(barrier_t *barrier);
+
+/* destroy a barrier */
+void barrier_destroy(barrier_t *barrier);
+
+#endif /* _BARRIER_H */
@@ -0,0 +1,56 @@
+/** @file channel.h
+ *  @brief The .h file of the bounded channel.
+ *
+ *  A channel passes pointers from any number of senders to any number of
+ *  receivers, in FIFO order, through a ring buffer of fixed capacity. A
+ *  sender blocks while the channel is full, a receiver while it is empty.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _CHANNEL_H
+#define _CHANNEL_H
+
+#include <linklist.h>
+
+/* a slot of the ring buffer */
+typedef struct {
+    volatile unsigned int seq;  /* position the slot is ready for */
+    void *item;
+} channel_cell_t;
+
+typedef struct channel {
+    channel_cell_t *cells;
+    unsigned int mask;          /* capacity - 1, capacity is a power of 2 */
+    volatile unsigned int head; /* next position to send to */
+    volatile unsigned int tail; /* next position to receive from */
+
+    int qlock;                  /* protect the queues */
+    volatile int send_waiters;  /* senders parked or about to park */
+    volatile int recv_waiters;  /* receivers parked or about to park */
+    linklist_t send_queue;
+    linklist_t recv_queue;
+} channel_t;
+
+/* initialize a channel, the capacity is rounded up to a power of 2 */
+int channel_init(channel_t *ch, int capacity);
+
+/* destroy an empty channel nobody waits on */
+void channel_destroy(channel_t *ch);
+
+/* send an item, block while the channel is full */
+void channel_send(channel_t *ch, void *item);
+
+/* receive an item, block while the channel is empty */
+void *channel_recv(channel_t *ch);
+
+/* send or receive without blocking, negative if the channel is full/empty */
+int channel_trysend(channel_t *ch, void *item);
+int channel_tryrecv(channel_t *ch, void **item);
+
+/* send or receive n items, taking as many slots at once as there are */
+void channel_send_n(channel_t *ch, void **items, int n);
+void channel_recv_n(channel_t *ch, void **items, int n);
+
+#endif /* _CHANNEL_H */
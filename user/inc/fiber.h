@@ -0,0 +1,74 @@
+/** @file fiber.h
+ *  @brief The .h file of fibers.
+ *
+ *  A fiber is a function run on a small stack of its own by a thread of
+ *  the library, which switches between its fibers in user space. Each
+ *  thread has its own fibers and runs them from fiber_run(); many threads
+ *  doing so multiplex fibers over kernel threads. A fiber runs until it
+ *  yields, returns or blocks on a mutex, condition variable, semaphore,
+ *  reader/writer lock, barrier, channel, pool or future; then the thread
+ *  switches to its next ready fiber instead of descheduling.
+ *
+ *  Fiber stacks come from an address range of their own and are kept for
+ *  reuse when a fiber ends. A fiber must not call thr_exit(), and the
+ *  thread calls fiber_run() until its fibers end before it exits.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _FIBER_H
+#define _FIBER_H
+
+#include <linklist.h>
+
+/* Pages of a fiber stack, below them an unmapped guard page */
+#define FIBER_STACK_PAGES 2
+
+/* Free fiber stacks a thread keeps for itself at most */
+#define FIBER_CACHE_MAX 32
+
+typedef void (*fiber_func_t)(void *arg);
+
+struct thread;
+struct waitnode;
+
+typedef struct fiber {
+    void *esp;                  /* saved while switched out */
+    struct fiber_sched *sched;  /* the thread running it */
+    fiber_func_t func;
+    void *arg;
+    int state;                  /* why it switched out */
+    volatile int sleep;         /* running, woken or parked */
+    int slot;                   /* index of its stack */
+    listnode_t node;            /* link in a run queue or a free list */
+} fiber_t;
+
+/* The fibers of one thread */
+typedef struct fiber_sched {
+    void *esp;                  /* the thread's, saved while a fiber runs */
+    struct thread *thread;
+    int nfibers;                /* fibers created and not ended */
+
+    linklist_t run_queue;       /* ready fibers, only used by the thread */
+    linklist_t cache;           /* free fiber stacks */
+    int ncached;
+
+    int qlock;                  /* protect the wake queue */
+    linklist_t wake_queue;      /* fibers woken by anybody */
+    struct waitnode *idle;      /* the thread waiting for a fiber to wake */
+} fiber_sched_t;
+
+/* create a fiber run by the calling thread, negative on error */
+int fiber_create(fiber_func_t func, void *arg);
+
+/* run the fibers of the calling thread until they all end */
+int fiber_run(void);
+
+/* let the next ready fiber of the thread run */
+void fiber_yield(void);
+
+/* the calling fiber, NULL if not called from a fiber */
+fiber_t *fiber_self(void);
+
+#endif /* _FIBER_H */
@@ -0,0 +1,53 @@
+/** @file future.h
+ *  @brief The .h file of futures.
+ *
+ *  A future holds one result which is set once, by any thread, and read by
+ *  any number of threads, which block until it is set. The result is kept
+ *  in the future itself, so a future on the stack of the waiting thread
+ *  takes no allocation; it must outlive the thread which sets it.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _FUTURE_H
+#define _FUTURE_H
+
+#include <linklist.h>
+
+/* Waits on more futures than this allocate their wait nodes */
+#define FUTURE_WAIT_NODES 16
+
+typedef struct future {
+    volatile int state;         /* empty, being set or ready */
+    void *value;
+
+    int qlock;                  /* protect the queue and the result */
+    linklist_t wait_queue;
+} future_t;
+
+/* initialize an empty future */
+void future_init(future_t *future);
+
+/* destroy a future nobody waits on, before it goes out of scope */
+void future_destroy(future_t *future);
+
+/* set the result and wake the waiters, negative if it was set already */
+int future_set(future_t *future, void *value);
+
+/* block until the result is set and return it */
+void *future_get(future_t *future);
+
+/* get the result without blocking, negative if it is not set */
+int future_try_get(future_t *future, void **value);
+
+/* block until all n futures are set, negative if n is not positive */
+int future_wait_all(future_t **futures, int n);
+
+/*
+ * block until any of n futures is set and return the lowest index set,
+ * negative if n is not positive or out of memory
+ */
+int future_wait_any(future_t **futures, int n);
+
+#endif /* _FUTURE_H */
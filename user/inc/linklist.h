@@ -26,5 +26,6 @@ void linklist_init(linklist_t *plist);
 listnode_t* linklist_delhead(linklist_t* plist);
 void linklist_addtail(linklist_t *plist, listnode_t *pnode);
 listnode_t* linklist_delall(linklist_t *plist);
+listnode_t* linklist_del(linklist_t *plist, listnode_t *pnode);
 
 #endif
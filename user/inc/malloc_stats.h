@@ -0,0 +1,50 @@
+/** @file malloc_stats.h
+ *  @brief Statistics of the malloc function family.
+ *
+ *  Only built with MALLOC_STATS defined. Without it the counters are not
+ *  in the library at all, and the functions below do nothing.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _MALLOC_STATS_H
+#define _MALLOC_STATS_H
+
+/* Uncomment, or build with -DMALLOC_STATS, to keep the statistics */
+/* #define MALLOC_STATS */
+
+/* Allocation buckets: 7 small size classes (16 to 1024 bytes), medium, large */
+#define MALLOC_STATS_MEDIUM 7
+#define MALLOC_STATS_LARGE 8
+#define MALLOC_STATS_BUCKETS 9
+
+typedef struct {
+    int allocs[MALLOC_STATS_BUCKETS];  /* allocations of each bucket */
+    int frees;
+    int bytes_live;     /* bytes allocated minus bytes freed */
+    int bytes_peak;     /* highest bytes_live */
+    int contended;      /* times a malloc mutex was taken after waiting */
+    int wait_ticks;     /* ticks waited for a malloc mutex */
+} malloc_stats_t;
+
+#ifdef MALLOC_STATS
+
+/*
+ * snapshot of the counters of the whole library, and of the calling thread
+ * (its allocations and frees, wherever the blocks came from); either may
+ * be NULL
+ */
+int malloc_stats(malloc_stats_t *global, malloc_stats_t *self);
+
+/* print the counters of the library and the calling thread */
+void malloc_stats_dump(void);
+
+#else
+
+#define malloc_stats(global, self) (-1)
+#define malloc_stats_dump() ((void)0)
+
+#endif /* MALLOC_STATS */
+
+#endif /* _MALLOC_STATS_H */
@@ -8,12 +8,14 @@
 #ifndef _MUTEX_TYPE_H
 #define _MUTEX_TYPE_H
 
+#include <linklist.h>
+
 typedef struct mutex {
-  int lock;
+  int lock;               /* unlocked, locked, or locked with waiters */
   int thread;
   int destroy;
-  int inmutex_count;
-  int countlock;
+  int qlock;              /* protect waitqueue */
+  linklist_t waitqueue;   /* threads blocked on the mutex */
 } mutex_t;
 
 #endif /* _MUTEX_TYPE_H */
@@ -0,0 +1,40 @@
+/** @file pool.h
+ *  @brief The .h file of the fixed-size object pool.
+ *
+ *  A pool hands out objects of one size. Objects come from slabs of pages
+ *  allocated with new_pages() in an address range of their own, not from
+ *  the malloc heap, and each thread keeps a few free objects of each pool
+ *  for itself. A pool and its slabs are never freed.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _POOL_H
+#define _POOL_H
+
+/* Number of pools at most */
+#define POOL_MAX 16
+
+/* Shared free list, a lock-free stack with a tag against ABA */
+typedef struct {
+    void *volatile head;
+    volatile int tag;
+} __attribute__((aligned(8))) pool_list_t;
+
+typedef struct {
+    int objsize;        /* object size, rounded up */
+    int id;             /* index of the per-thread cache */
+    pool_list_t free;   /* free objects not cached by any thread */
+} pool_t;
+
+/* create a pool of objects of objsize bytes */
+pool_t *pool_create(int objsize);
+
+/* allocate an object */
+void *pool_alloc(pool_t *pool);
+
+/* free an object of the pool */
+void pool_free(pool_t *pool, void *obj);
+
+#endif /* _POOL_H */
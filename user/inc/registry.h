@@ -0,0 +1,47 @@
+/** @file registry.h
+ *  @brief The .h file of the registry functions.
+ *
+ *  A registry maps a positive integer key to a pointer. Lookups do not take
+ *  any lock, insert and remove are serialized by a sequence lock.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _REGISTRY_H
+#define _REGISTRY_H
+
+#include <seqlock.h>
+
+/* registry entry, key 0 means empty */
+typedef struct {
+    volatile int key;
+    void *volatile data;
+} registry_entry_t;
+
+/* open addressing table, never freed once published */
+typedef struct registry_table {
+    int size;       /* number of entries, power of 2 */
+    int count;      /* number of keys */
+    registry_entry_t *entries;
+    struct registry_table *retired;    /* older tables */
+} registry_table_t;
+
+typedef struct {
+    registry_table_t *volatile table;  /* current table */
+    seqlock_t lock;     /* odd while a writer moves keys */
+} registry_t;
+
+/* initialize a registry */
+int registry_init(registry_t *reg, int size);
+
+/* insert a (key, data) pair */
+int registry_insert(registry_t *reg, int key, void *data);
+
+/* remove a key */
+int registry_remove(registry_t *reg, int key);
+
+/* search for the data of a key */
+void *registry_lookup(registry_t *reg, int key);
+
+#endif /* _REGISTRY_H */
@@ -10,16 +10,23 @@
 #ifndef _RWLOCK_TYPE_H
 #define _RWLOCK_TYPE_H
 
+#include <linklist.h>
+
 #define INVALID_CNT -1
 
+/* Preference when both readers and writers wait */
+#define RWLOCK_PREFER_WRITER 0  /* default, new readers wait for writers */
+#define RWLOCK_PREFER_READER 1
+
 typedef struct rwlock {
-    int rd_cnt;
-    int wr_cnt;
-    mutex_t rdcnt_mutex;
-    mutex_t wrcnt_mutex;
-    cond_t rd_cond;
-    cond_t wr_cond;
-	cond_t writer_cond;
+    int state;              /* reader count, waiting bits and writer bit */
+    int pref;               /* RWLOCK_PREFER_WRITER or RWLOCK_PREFER_READER */
+    int qlock;              /* protect the queues */
+    linklist_t rd_queue;    /* readers parked */
+    linklist_t wr_queue;    /* writers parked */
 } rwlock_t;
 
+/* init a rwlock with a preference */
+int rwlock_init_pref(struct rwlock *rwlock, int pref);
+
 #endif /* _RWLOCK_TYPE_H */
@@ -9,17 +9,26 @@
 #ifndef _SEM_TYPE_H
 #define _SEM_TYPE_H
 
-#include <mutex_type.h>
-#include <cond_type.h>
+#include <linklist.h>
 
 #define SEM_DESTR_NO 0
 #define SEM_DESTR_YES 1
 
 typedef struct sem {
-    int count;
-    mutex_t mutex;
-    cond_t cond;
+    int count;              /* negative: units owed to waiting threads */
     int destr;
+    int qlock;              /* protect waitqueue and tokens */
+    int tokens;             /* units signaled before their waiter queued */
+    linklist_t waitqueue;   /* threads blocked on the semaphore */
 } sem_t;
 
+/* take a unit if there is one, without blocking */
+int sem_trywait(struct sem *sem);
+
+/* take n units, blocking until there are enough */
+void sem_wait_n(struct sem *sem, int n);
+
+/* give n units */
+void sem_signal_n(struct sem *sem, int n);
+
 #endif /* _SEM_TYPE_H */
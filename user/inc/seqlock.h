@@ -0,0 +1,43 @@
+/** @file seqlock.h
+ *  @brief The .h file of the sequence lock.
+ *
+ *  A sequence lock protects data which is read often and written rarely.
+ *  Writers take a mutex and make the sequence number odd while they change
+ *  the data. Readers do not write anything: they read the data between
+ *  seqlock_read_begin() and seqlock_read_retry(), and read it again if a
+ *  writer was active meanwhile. So a reader must not follow pointers it
+ *  has read unless the memory stays valid.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _SEQLOCK_H
+#define _SEQLOCK_H
+
+#include <mutex_type.h>
+
+typedef struct seqlock {
+    volatile unsigned int seq;  /* odd while a writer changes the data */
+    mutex_t mutex;              /* serialize writers */
+} seqlock_t;
+
+/* initialize a sequence lock */
+int seqlock_init(seqlock_t *sl);
+
+/* destroy a sequence lock */
+void seqlock_destroy(seqlock_t *sl);
+
+/* start and end a change of the data */
+void seqlock_write_begin(seqlock_t *sl);
+void seqlock_write_end(seqlock_t *sl);
+
+/* take the writer mutex without making readers retry */
+void seqlock_lock(seqlock_t *sl);
+void seqlock_unlock(seqlock_t *sl);
+
+/* start a read, and check if it has to be done again */
+unsigned int seqlock_read_begin(seqlock_t *sl);
+int seqlock_read_retry(seqlock_t *sl, unsigned int seq);
+
+#endif /* _SEQLOCK_H */
@@ -9,6 +9,49 @@
 #include <mutex.h>
 #include <cond.h>
 #include <def.h>
+#include <thrstack.h>
+#include <pool.h>
+#include <arena.h>
+#include <tpool.h>
+#include <fiber.h>
+#include <malloc_stats.h>
+
+/* Wait node, lives on the stack of a blocked thread */
+typedef struct waitnode {
+    listnode_t node;    /* link in the wait queue, must be the first member */
+    int tid;            /* the blocked thread */
+    mutex_t *mp;        /* mutex to get back after a condition wait */
+    int locked;         /* the mutex has been handed to the thread */
+    volatile int woken; /* set by the waker, the only way out of the wait */
+    fiber_t *fiber;     /* the blocked fiber, NULL for a thread */
+} waitnode_t;
+
+/* 
+ * Stack regions recorded for trimming. A stack can only be trimmed region by
+ * region, the last growth takes all the room left when the record is full.
+ */
+#define STACK_REGION_MAX 32
+
+/* Size classes of the per-thread malloc cache: 16, 32, ... 1024 bytes */
+#define MALLOC_CLASSES 7
+
+/* Per-thread malloc cache, see malloc.c */
+typedef struct {
+    void *head[MALLOC_CLASSES];     /* free blocks of each size class */
+    int count[MALLOC_CLASSES];
+    void *volatile remote;          /* blocks freed by other threads */
+} malloc_cache_t;
+
+/* Per-thread pool cache, see pool.c */
+typedef struct {
+    void *head[POOL_MAX];   /* free objects of each pool */
+    int count[POOL_MAX];
+} pool_cache_t;
+
+/* Start handshake of a new thread, see do_thread() */
+#define THREAD_START_WAIT 0     /* the parent has not registered it yet */
+#define THREAD_START_GO 1       /* it may start */
+#define THREAD_START_PARKED 2   /* it deschedules until the parent wakes it */
 
 /* Thread status */
 #define RUNNING 0
@@ -17,12 +60,13 @@
 typedef void *(*func_t)(void *);
 
 /* Thread information struture */
-typedef struct{
+typedef struct thread {
     int tid;
     void *stack_base;
     int stack_size; /* current stack size */
 
     int status;
+    int started;      /* start handshake, THREAD_START_* */
 
     int join_thread;  /* joining thread, default is INVALID_THREAD */
     void *exit_status;
@@ -32,14 +76,43 @@ typedef struct{
 
     func_t func;
     void * arg;
+
+    /* Stack growth, only changed by the thread itself after it starts */
+    thr_stack_policy_t stack_policy;
+    int last_grow;      /* bytes of the last stack growth */
+    int stack_faults;   /* stack growth faults taken */
+
+    /* Sizes of the stack regions below the first two pages, top down */
+    int stack_regions[STACK_REGION_MAX];
+    int stack_nregions;
+
+    /* Kept with the stack slot, emptied when the thread exits */
+    malloc_cache_t malloc_cache;
+    pool_cache_t pool_cache;
+
+    /* Arenas bound to the thread, destroyed when it exits */
+    arena_t *arenas;
+
+    /* Set while the thread is a worker of a thread pool */
+    tpool_worker_t *tpool_worker;
+
+    /* Fibers run by the thread, created by the first fiber_create() */
+    fiber_sched_t *fiber_sched;
+
+#ifdef MALLOC_STATS
+    malloc_stats_t malloc_stats;    /* only changed by the thread itself */
+#endif
 } thread_t;
 
 /* Functions */
 int init_thread_lib(unsigned int size);
 
 thread_t *get_thread_by_tid(int tid);
+thread_t *get_self_thread(void);
+int get_self_tid(void);
 
-thread_t *prepare_thread(void *(*func)(void *), void * arg);
+thread_t *prepare_thread(void *(*func)(void *), void * arg,
+                         const thr_stack_policy_t *policy);
 void do_thread();
 void prepare_thread_rollback(thread_t *thread);
 
@@ -47,4 +120,36 @@ void make_thread_running(int tid, thread_t *new_thread);
 void exit_thread(thread_t *thread);
 void reap_thread(thread_t *thread, int tid);
 
+int get_thread_index(thread_t *thread);
+thread_t *get_thread_by_index(int index);
+void malloc_thread_exit(thread_t *thread);
+void pool_thread_exit(thread_t *thread);
+void arena_thread_exit(thread_t *thread);
+
+void record_stack_region(thread_t *thread, int size);
+int set_stack_trim(int watermark_pages);
+void get_stack_stats(thr_stack_stats_t *stats);
+int check_stack_policy(const thr_stack_policy_t *policy);
+int set_stack_policy(const thr_stack_policy_t *policy);
+thr_stack_policy_t *get_stack_policy(void);
+
+/* Wait queue */
+void waitq_lock(int *qlock);
+void waitq_unlock(int *qlock);
+void waitnode_init(waitnode_t *waiter);
+void waitnode_sleep(waitnode_t *waiter);
+void waitnode_wakeup(waitnode_t *waiter);
+void mutex_requeue(mutex_t *mp, waitnode_t *waiter);
+
+/* Fibers */
+void fiber_park(fiber_t *fiber);
+void fiber_wake(fiber_t *fiber);
+
+/* Atomic operations */
+int atom_xchg(int *addr, int value);
+int atom_cmpxchg(int *addr, int expect, int value);
+int atom_add(int *addr, int value);
+int atom_cmpxchg64(void *addr, int expect_lo, int expect_hi, 
+                   int value_lo, int value_hi);
+
 #endif /* THR_INTERNALS_H */
@@ -0,0 +1,59 @@
+/** @file thrstack.h
+ *  @brief Stack growth policy of the thread library.
+ *
+ *  A stack grows in the autostack handler when a thread touches the page
+ *  below its stack. The policy tells how much more than the faulting page
+ *  is allocated each time, so deep recursion takes fewer faults. A stack
+ *  never grows over the size given to thr_init().
+ *
+ *  A recycled stack keeps the pages it has grown to, unless a trim 
+ *  watermark is set.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _THRSTACK_H
+#define _THRSTACK_H
+
+/* Growth policies */
+#define THR_STACK_GROW_FIXED 0   /* grow by chunk_pages each time */
+#define THR_STACK_GROW_DOUBLE 1  /* double the last growth, up to a cap */
+
+/*
+ * Stack growth policy. All zero is the default: grow exactly to the
+ * faulting page, allocate nothing ahead.
+ */
+typedef struct {
+    int policy;           /* THR_STACK_GROW_FIXED or THR_STACK_GROW_DOUBLE */
+    int chunk_pages;      /* pages of a growth, the first one if doubling */
+    int max_chunk_pages;  /* cap of a doubling growth, 0 for no cap */
+    int prefault_pages;   /* stack pages allocated when a thread is created */
+} thr_stack_policy_t;
+
+/* set the policy of the root thread (before thr_init) and new threads */
+int thr_setstackpolicy(const thr_stack_policy_t *policy);
+
+/* create a thread with its own policy, NULL for the global one */
+int thr_create_policy(void *(*func)(void *), void *arg,
+                      const thr_stack_policy_t *policy);
+
+/* number of stack growth faults taken by the calling thread */
+int thr_getstackfaults(void);
+
+/* Stack memory of the thread library */
+typedef struct {
+    int committed_bytes;  /* stack pages allocated now */
+    int trimmed_bytes;    /* stack pages removed from recycled stacks */
+} thr_stack_stats_t;
+
+/* 
+ * trim a stack down to watermark_pages pages when its thread is reaped,
+ * negative (the default) to keep every page
+ */
+int thr_setstacktrim(int watermark_pages);
+
+/* get the stack memory counters */
+void thr_getstackstats(thr_stack_stats_t *stats);
+
+#endif /* _THRSTACK_H */
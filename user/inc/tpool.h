@@ -0,0 +1,94 @@
+/** @file tpool.h
+ *  @brief The .h file of the work-stealing thread pool.
+ *
+ *  A pool runs tasks, a function and its argument, on a fixed set of
+ *  worker threads. Each worker has a deque of tasks: it takes the newest
+ *  of its own, and an idle worker steals the oldest of another's. A task
+ *  submitted by a worker goes to the worker's deque, one submitted by any
+ *  other thread to a shared queue. Workers with nothing to do park.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _TPOOL_H
+#define _TPOOL_H
+
+#include <mutex.h>
+#include <linklist.h>
+
+/* Most workers of a pool */
+#define TPOOL_MAX_WORKERS 64
+
+/* Initial number of slots of a deque and of the shared queue */
+#define TPOOL_DEQUE_SIZE 256
+
+typedef void (*tpool_func_t)(void *arg);
+
+typedef struct {
+    tpool_func_t func;
+    void *arg;
+} tpool_task_t;
+
+/* Slots of a deque; a grown deque keeps the old array until destroyed */
+typedef struct tpool_array {
+    int mask;                   /* size - 1, size is a power of 2 */
+    struct tpool_array *prev;   /* the array it replaced */
+    tpool_task_t *tasks;
+} tpool_array_t;
+
+/* Chase-Lev deque: the owner pushes and pops at bottom, thieves at top */
+typedef struct tpool_worker {
+    volatile unsigned int top;
+    volatile unsigned int bottom;
+    tpool_array_t *volatile array;
+
+    struct tpool *pool;
+    int index;
+    int tid;
+    unsigned int seed;          /* picks the first victim to steal from */
+    int depth;                  /* tasks running on its stack */
+    char pad[32];               /* a worker per cache line */
+} tpool_worker_t;
+
+typedef struct tpool {
+    int nworkers;
+    tpool_worker_t *workers;
+
+    /* tasks submitted by threads which are not workers, a ring */
+    mutex_t inject_mutex;
+    tpool_task_t *inject;
+    int inject_size;
+    int inject_head;
+    volatile int inject_count;
+
+    volatile int pending;       /* tasks submitted and not finished */
+    volatile int nested;        /* tasks blocked in tpool_wait() */
+    volatile int idle;          /* workers parked or about to park */
+    volatile int shutdown;
+
+    int qlock;                  /* protect the queues */
+    linklist_t idle_queue;      /* parked workers, and waiting ones */
+    linklist_t wait_queue;      /* other threads in tpool_wait() */
+} tpool_t;
+
+/*
+ * create a pool of nworkers workers; stacksize bytes of each worker's
+ * stack are allocated up front, 0 for the default
+ */
+tpool_t *tpool_create(int nworkers, int stacksize);
+
+/* run func(arg) on a worker, negative if out of memory */
+int tpool_submit(tpool_t *pool, tpool_func_t func, void *arg);
+
+/*
+ * wait until every task submitted has finished; a worker runs tasks.
+ * From a task, wait until every task but those blocked in tpool_wait(),
+ * the caller's among them, has finished
+ */
+void tpool_wait(tpool_t *pool);
+
+/* wait for the tasks, stop the workers and free the pool */
+void tpool_destroy(tpool_t *pool);
+
+#endif /* _TPOOL_H */
@@ -0,0 +1,66 @@
+/** @file crt0.c
+ *  @brief Start a Pebbles program as a Linux process.
+ *
+ *  The root thread gets a stack of its own at the top of the Pebbles user
+ *  address space, so the autostack handler can grow it with new_pages()
+ *  as it would under the Pebbles kernel. argv still points into the Linux
+ *  stack, which stays mapped.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "linux_syscall.h"
+
+/* Top of the root thread stack, and the pages it starts with */
+#define ROOT_STACK_HIGH 0xBFFFFFFF
+#define ROOT_STACK_PAGES 4
+#define ROOT_STACK_LOW (ROOT_STACK_HIGH + 1 - ROOT_STACK_PAGES * PAGE_SIZE)
+
+extern int main(int argc, char *argv[]);
+extern void install_autostack(void *stack_high, void *stack_low);
+
+/* %esi keeps the Linux stack, where argc and argv are */
+__asm__(".global _start\n"
+        "_start:\n"
+        "    movl %esp,%esi\n"
+        "    call linux_root_stack\n"
+        "    movl $0xBFFFFFF0,%esp\n"
+        "    xorl %ebp,%ebp\n"
+        "    pushl %esi\n"
+        "    call linux_main\n"
+        "    hlt\n");
+
+/** @brief Map the root thread stack, still on the Linux stack
+ *
+ *  @return Void
+ */
+void linux_root_stack(void)
+{
+    int ret;
+
+    ret = linux_syscall6(LINUX_NR_mmap2, ROOT_STACK_LOW,
+                         ROOT_STACK_PAGES * PAGE_SIZE, LINUX_PROT_RW,
+                         LINUX_MAP_PRIVATE_ANON | LINUX_MAP_FIXED_NOREPLACE,
+                         -1, 0);
+    if(ret != ROOT_STACK_LOW)
+        task_vanish(-1);
+}
+
+/** @brief Set up the emulation and run main()
+ *
+ *  @param args the Linux stack: argc, then argv
+ *  @return Void
+ */
+void linux_main(int *args)
+{
+    linux_ticks_init();
+    linux_thread_root();
+    linux_install_signals();
+    install_autostack((void *)ROOT_STACK_HIGH, (void *)ROOT_STACK_LOW);
+
+    exit(main(args[0], (char **)&args[1]));
+}
@@ -0,0 +1,14 @@
+/** @file assert.h
+ *  @brief assert() panics with the failed expression.
+ */
+#ifndef _ASSERT_H
+#define _ASSERT_H
+
+#include <stdlib.h>
+
+#define assert(expr) \
+    ((void)((expr) ? 0 : \
+            (panic("%s:%u: failed assertion `%s'", __FILE__, __LINE__, \
+                   #expr), 0)))
+
+#endif /* _ASSERT_H */
@@ -0,0 +1,20 @@
+/** @file malloc.h
+ *  @brief The thread-safe malloc() family, and the unsafe one under it.
+ */
+#ifndef _MALLOC_H
+#define _MALLOC_H
+
+#include <stddef.h>
+
+void *malloc(size_t size);
+void *calloc(size_t nelt, size_t eltsize);
+void *realloc(void *buf, size_t new_size);
+void free(void *buf);
+
+void *_malloc(size_t size);
+void *_memalign(size_t alignment, size_t size);
+void *_calloc(size_t nelt, size_t eltsize);
+void *_realloc(void *buf, size_t new_size);
+void _free(void *buf);
+
+#endif /* _MALLOC_H */
@@ -0,0 +1,11 @@
+/** @file simics.h
+ *  @brief Simulator hooks; lprintf() writes to standard error.
+ */
+#ifndef _SIMICS_H
+#define _SIMICS_H
+
+void lprintf(const char *fmt, ...);
+
+#define MAGIC_BREAK do { } while (0)
+
+#endif /* _SIMICS_H */
@@ -0,0 +1,18 @@
+/** @file stdio.h
+ *  @brief Formatted output.
+ */
+#ifndef _STDIO_H
+#define _STDIO_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+int printf(const char *fmt, ...);
+int vprintf(const char *fmt, va_list vl);
+int sprintf(char *buf, const char *fmt, ...);
+int snprintf(char *buf, size_t size, const char *fmt, ...);
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list vl);
+int putchar(int c);
+int puts(const char *s);
+
+#endif /* _STDIO_H */
@@ -0,0 +1,15 @@
+/** @file stdlib.h
+ *  @brief Memory allocation and process control.
+ */
+#ifndef _STDLIB_H
+#define _STDLIB_H
+
+#include <stddef.h>
+#include <malloc.h>
+
+int atoi(const char *s);
+int abs(int n);
+void exit(int status) __attribute__((noreturn));
+void panic(const char *fmt, ...) __attribute__((noreturn));
+
+#endif /* _STDLIB_H */
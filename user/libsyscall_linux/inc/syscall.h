@@ -0,0 +1,48 @@
+/** @file syscall.h
+ *  @brief The Pebbles system call interface, as the Linux backend
+ *         provides it.
+ */
+#ifndef _SYSCALL_H
+#define _SYSCALL_H
+
+#include <ureg.h>
+
+#define PAGE_SIZE 0x0001000 /* 4096 */
+
+typedef void (*swexn_handler_t)(void *arg, ureg_t *ureg);
+
+/* Life cycle */
+int fork(void);
+int exec(char *execname, char *argvec[]);
+void set_status(int status);
+void vanish(void) __attribute__((noreturn));
+int wait(int *status_ptr);
+void task_vanish(int status) __attribute__((noreturn));
+
+/* Thread management */
+int gettid(void);
+int yield(int pid);
+int deschedule(int *flag);
+int make_runnable(int pid);
+int get_ticks(void);
+int sleep(int ticks);
+int swexn(void *esp3, swexn_handler_t eip, void *arg, ureg_t *newureg);
+
+/* Memory management */
+int new_pages(void *addr, int len);
+int remove_pages(void *addr);
+
+/* Console I/O */
+char getchar(void);
+int readline(int size, char *buf);
+int print(int size, char *buf);
+int set_term_color(int color);
+int set_cursor_pos(int row, int col);
+int get_cursor_pos(int *row, int *col);
+
+/* Miscellaneous */
+void halt(void);
+int ls(int size, char *buf);
+void misbehave(int mode);
+
+#endif /* _SYSCALL_H */
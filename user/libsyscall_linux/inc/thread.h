@@ -0,0 +1,14 @@
+/** @file thread.h
+ *  @brief The thread library interface.
+ */
+#ifndef _THREAD_H
+#define _THREAD_H
+
+int thr_init(unsigned int size);
+int thr_create(void *(*func)(void *), void *args);
+int thr_join(int tid, void **statusp);
+void thr_exit(void *status);
+int thr_getid(void);
+int thr_yield(int tid);
+
+#endif /* _THREAD_H */
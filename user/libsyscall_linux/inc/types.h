@@ -0,0 +1,9 @@
+/** @file types.h
+ *  @brief Basic types.
+ */
+#ifndef _TYPES_H
+#define _TYPES_H
+
+#include <stddef.h>
+
+#endif /* _TYPES_H */
@@ -0,0 +1,456 @@
+/** @file libc.c
+ *  @brief The part of the Pebbles C library the thread library and the
+ *         test programs use.
+ *
+ *  The Linux C library can not be used: it keeps per-thread state which
+ *  threads made by a bare clone() do not have, and its malloc() would
+ *  clash with ours. _malloc() and friends are not thread safe, like those
+ *  of Pebbles; malloc() serializes the calls.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <syscall.h>
+#include "linux_syscall.h"
+
+/* Heap of _malloc(), grown 1MB at a time */
+#define HEAP_BASE 0x20000000
+#define HEAP_LIMIT 0x30000000
+#define HEAP_GROW 0x100000
+
+/* Size classes 16 << bin; 256MB at most */
+#define HEAP_BINS 25
+
+/* In front of each block */
+typedef struct {
+    int bin;
+    int offset;     /* from the start of the block to the user pointer */
+} heap_hdr_t;
+
+static char *heap_cur = (char *)HEAP_BASE;
+static char *heap_end = (char *)HEAP_BASE;
+static void *heap_free[HEAP_BINS];
+
+void *memset(void *s, int c, size_t n)
+{
+    unsigned char *p = s;
+
+    while(n--)
+        *p++ = c;
+    return s;
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+
+    while(n--)
+        *d++ = *s++;
+    return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+
+    if(d < s)
+        return memcpy(dst, src, n);
+
+    d += n;
+    s += n;
+    while(n--)
+        *--d = *--s;
+    return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n)
+{
+    const unsigned char *p = a, *q = b;
+
+    for(; n > 0; n--, p++, q++){
+        if(*p != *q)
+            return *p - *q;
+    }
+    return 0;
+}
+
+size_t strlen(const char *s)
+{
+    size_t n = 0;
+
+    while(s[n])
+        n++;
+    return n;
+}
+
+int strcmp(const char *a, const char *b)
+{
+    while(*a && *a == *b){
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+int strncmp(const char *a, const char *b, size_t n)
+{
+    for(; n > 0; n--, a++, b++){
+        if(*a != *b || *a == 0)
+            return (unsigned char)*a - (unsigned char)*b;
+    }
+    return 0;
+}
+
+char *strcpy(char *dst, const char *src)
+{
+    char *d = dst;
+
+    while((*d++ = *src++) != 0)
+        continue;
+    return dst;
+}
+
+int atoi(const char *s)
+{
+    int n = 0, neg = 0;
+
+    while(*s == ' ' || *s == '\t')
+        s++;
+    if(*s == '-' || *s == '+')
+        neg = (*s++ == '-');
+    while(*s >= '0' && *s <= '9')
+        n = n * 10 + (*s++ - '0');
+
+    return neg ? -n : n;
+}
+
+int abs(int n)
+{
+    return n < 0 ? -n : n;
+}
+
+/** @brief Format into a buffer
+ *
+ *  %d %i %u %x %p %s %c and %%, with a width, '-' and '0' flags and an
+ *  ignored 'l'.
+ *
+ *  @param buf buffer
+ *  @param size bytes of the buffer
+ *  @param fmt format
+ *  @param vl arguments
+ *  @return length of the whole output, even if it did not fit
+ */
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list vl)
+{
+    char tmp[16];
+    const char *s;
+    size_t len = 0;
+    unsigned int u = 0;
+    int base, neg, left, zero, width, n;
+
+#define PUT(c) do { if(len + 1 < size) buf[len] = (c); len++; } while(0)
+
+    for(; *fmt; fmt++){
+        if(*fmt != '%'){
+            PUT(*fmt);
+            continue;
+        }
+
+        left = zero = width = 0;
+        for(fmt++; *fmt == '-' || *fmt == '0'; fmt++){
+            if(*fmt == '-')
+                left = 1;
+            else
+                zero = 1;
+        }
+        while(*fmt >= '0' && *fmt <= '9')
+            width = width * 10 + (*fmt++ - '0');
+        while(*fmt == 'l')
+            fmt++;
+
+        n = 0;
+        neg = 0;
+        base = 10;
+        switch(*fmt){
+        case 's':
+            if((s = va_arg(vl, const char *)) == NULL)
+                s = "(null)";
+            n = strlen(s);
+            break;
+        case 'c':
+            tmp[0] = (char)va_arg(vl, int);
+            s = tmp;
+            n = 1;
+            break;
+        case 'd':
+        case 'i':
+            n = va_arg(vl, int);
+            neg = n < 0;
+            u = neg ? -(unsigned int)n : (unsigned int)n;
+            n = -1;
+            break;
+        case 'u':
+            u = va_arg(vl, unsigned int);
+            n = -1;
+            break;
+        case 'x':
+        case 'X':
+        case 'p':
+            u = va_arg(vl, unsigned int);
+            base = 16;
+            n = -1;
+            break;
+        case '%':
+            PUT('%');
+            continue;
+        default:
+            if(*fmt == 0)
+                fmt--;
+            continue;
+        }
+
+        /* a number, in reverse at the end of tmp */
+        if(n < 0){
+            s = tmp + sizeof(tmp);
+            do {
+                *(char *)--s = "0123456789abcdef"[u % base];
+                u /= base;
+            } while(u);
+            if(*fmt == 'p'){
+                *(char *)--s = 'x';
+                *(char *)--s = '0';
+            }
+            n = tmp + sizeof(tmp) - s;
+            if(neg && zero){
+                PUT('-');
+                width--;
+            }
+            else if(neg){
+                *(char *)--s = '-';
+                n++;
+            }
+        }
+        else
+            zero = 0;
+
+        for(width -= n; !left && width > 0; width--)
+            PUT(zero ? '0' : ' ');
+        while(n-- > 0)
+            PUT(*s++);
+        for(; left && width > 0; width--)
+            PUT(' ');
+    }
+
+#undef PUT
+
+    if(size > 0)
+        buf[len < size ? len : size - 1] = 0;
+    return len;
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list vl;
+    int ret;
+
+    va_start(vl, fmt);
+    ret = vsnprintf(buf, size, fmt, vl);
+    va_end(vl);
+    return ret;
+}
+
+int sprintf(char *buf, const char *fmt, ...)
+{
+    va_list vl;
+    int ret;
+
+    va_start(vl, fmt);
+    ret = vsnprintf(buf, (size_t)-1 / 2, fmt, vl);
+    va_end(vl);
+    return ret;
+}
+
+int vprintf(const char *fmt, va_list vl)
+{
+    char buf[1024];
+    int ret;
+
+    ret = vsnprintf(buf, sizeof(buf), fmt, vl);
+    print(ret < (int)sizeof(buf) ? ret : (int)sizeof(buf) - 1, buf);
+    return ret;
+}
+
+int printf(const char *fmt, ...)
+{
+    va_list vl;
+    int ret;
+
+    va_start(vl, fmt);
+    ret = vprintf(fmt, vl);
+    va_end(vl);
+    return ret;
+}
+
+int putchar(int c)
+{
+    char ch = c;
+
+    print(1, &ch);
+    return c;
+}
+
+int puts(const char *s)
+{
+    print(strlen(s), (char *)s);
+    print(1, "\n");
+    return 0;
+}
+
+/** @brief Log to the simulator; here, to standard error
+ *
+ *  @param fmt format
+ *  @return Void
+ */
+void lprintf(const char *fmt, ...)
+{
+    char buf[256];
+    va_list vl;
+    int len;
+
+    va_start(vl, fmt);
+    len = vsnprintf(buf, sizeof(buf) - 1, fmt, vl);
+    va_end(vl);
+
+    if(len > (int)sizeof(buf) - 2)
+        len = sizeof(buf) - 2;
+    buf[len++] = '\n';
+    linux_syscall(LINUX_NR_write, 2, buf, len);
+}
+
+void exit(int status)
+{
+    set_status(status);
+    vanish();
+}
+
+/** @brief Take a block of a size class
+ *
+ *  @param bin size class
+ *  @return start of the block, NULL if the heap is full
+ */
+static char *heap_take(int bin)
+{
+    char *p;
+    int ret;
+
+    if((p = heap_free[bin]) != NULL){
+        heap_free[bin] = *(void **)p;
+        return p;
+    }
+
+    while(heap_cur + (16 << bin) > heap_end){
+        if(heap_end >= (char *)HEAP_LIMIT)
+            return NULL;
+        ret = linux_syscall6(LINUX_NR_mmap2, (int)heap_end, HEAP_GROW,
+                             LINUX_PROT_RW,
+                             LINUX_MAP_PRIVATE_ANON | LINUX_MAP_FIXED_NOREPLACE,
+                             -1, 0);
+        if(ret != (int)heap_end)
+            return NULL;
+        heap_end += HEAP_GROW;
+    }
+
+    p = heap_cur;
+    heap_cur += 16 << bin;
+    return p;
+}
+
+void *_memalign(size_t alignment, size_t size)
+{
+    heap_hdr_t *hdr;
+    char *p, *user;
+    size_t need;
+    int bin = 0;
+
+    if(alignment < sizeof(heap_hdr_t))
+        alignment = sizeof(heap_hdr_t);
+    if(alignment & (alignment - 1))
+        return NULL;
+
+    /* blocks are 8-byte aligned, so the header and the padding fit */
+    need = size + alignment;
+    if(need < size)
+        return NULL;
+    while(bin < HEAP_BINS && (size_t)(16 << bin) < need)
+        bin++;
+    if(bin == HEAP_BINS || (p = heap_take(bin)) == NULL)
+        return NULL;
+
+    user = (char *)(((unsigned int)p + sizeof(heap_hdr_t) + alignment - 1) &
+                    ~(alignment - 1));
+    hdr = (heap_hdr_t *)user - 1;
+    hdr->bin = bin;
+    hdr->offset = user - p;
+    return user;
+}
+
+void *_malloc(size_t size)
+{
+    return _memalign(sizeof(heap_hdr_t), size);
+}
+
+void *_calloc(size_t nelt, size_t eltsize)
+{
+    void *p;
+
+    if(eltsize != 0 && nelt > (size_t)-1 / eltsize)
+        return NULL;
+    if((p = _malloc(nelt * eltsize)) != NULL)
+        memset(p, 0, nelt * eltsize);
+    return p;
+}
+
+void _free(void *buf)
+{
+    heap_hdr_t *hdr;
+    char *p;
+
+    if(buf == NULL)
+        return;
+
+    hdr = (heap_hdr_t *)buf - 1;
+    p = (char *)buf - hdr->offset;
+    *(void **)p = heap_free[hdr->bin];
+    heap_free[hdr->bin] = p;
+}
+
+void *_realloc(void *buf, size_t new_size)
+{
+    heap_hdr_t *hdr;
+    size_t old_size;
+    void *p;
+
+    if(buf == NULL)
+        return _malloc(new_size);
+
+    hdr = (heap_hdr_t *)buf - 1;
+    old_size = (16 << hdr->bin) - hdr->offset;
+    if(new_size <= old_size)
+        return buf;
+
+    if((p = _malloc(new_size)) == NULL)
+        return NULL;
+    memcpy(p, buf, old_size);
+    _free(buf);
+    return p;
+}
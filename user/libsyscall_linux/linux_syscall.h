@@ -0,0 +1,106 @@
+/** @file linux_syscall.h
+ *  @brief Private definitions of the Linux syscall backend.
+ *
+ *  The backend traps into Linux with int $0x80 (i386 calling convention),
+ *  so it needs no C library.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _LINUX_SYSCALL_H
+#define _LINUX_SYSCALL_H
+
+#include <syscall.h>
+
+/* i386 Linux system call numbers */
+#define LINUX_NR_exit 1
+#define LINUX_NR_read 3
+#define LINUX_NR_write 4
+#define LINUX_NR_getpid 20
+#define LINUX_NR_munmap 91
+#define LINUX_NR_clone 120
+#define LINUX_NR_rt_sigreturn 173
+#define LINUX_NR_rt_sigaction 174
+#define LINUX_NR_sched_yield 158
+#define LINUX_NR_nanosleep 162
+#define LINUX_NR_sigaltstack 186
+#define LINUX_NR_mmap2 192
+#define LINUX_NR_gettid 224
+#define LINUX_NR_futex 240
+#define LINUX_NR_exit_group 252
+#define LINUX_NR_clock_gettime 265
+#define LINUX_NR_tgkill 270
+
+/* Linux flags and constants */
+#define LINUX_PROT_RW 3
+#define LINUX_MAP_PRIVATE_ANON 0x22
+#define LINUX_MAP_FIXED 0x10
+#define LINUX_MAP_FIXED_NOREPLACE 0x100000
+#define LINUX_FUTEX_WAIT_PRIVATE 128
+#define LINUX_FUTEX_WAKE_PRIVATE 129
+#define LINUX_CLOCK_MONOTONIC 1
+#define LINUX_SIGILL 4
+#define LINUX_SIGBUS 7
+#define LINUX_SIGFPE 8
+#define LINUX_SIGSEGV 11
+#define LINUX_SIGUSR2 12
+
+/* Most threads alive at once, and the largest Linux thread id + 1 */
+#define LINUX_MAX_THREADS 8192
+#define LINUX_TID_MAX (1 << 22)
+
+/* Stack of the signal handler of each thread */
+#define LINUX_ALTSTACK_SIZE (32 * 1024)
+
+/* A Pebbles tick is one millisecond */
+#define LINUX_TICK_NS 1000000
+
+/* Pebbles view of a Linux thread */
+typedef struct {
+    volatile int tid;      /* -1 while thread_fork() runs, 0 when free */
+    volatile int run;      /* 0 while descheduled, futex word */
+    void *esp3;            /* registered swexn handler */
+    swexn_handler_t eip;
+    void *arg;
+    ureg_t *volatile pending;  /* registers swexn() should return to */
+    void *altstack;        /* kept for the next thread of the entry */
+    int altstack_tid;      /* thread which has the altstack set up */
+} linux_thread_t;
+
+/** @brief Trap into Linux with up to 6 arguments
+ *
+ *  @param n system call number
+ *  @return what Linux returns, -errno on failure
+ */
+static inline int linux_syscall6(int n, int a, int b, int c, int d, int e,
+                                 int f)
+{
+    int ret;
+
+    /* %ebp holds the 6th argument, it may be the frame pointer */
+    __asm__ volatile("pushl %%ebp\n\t"
+                     "movl %7,%%ebp\n\t"
+                     "int $0x80\n\t"
+                     "popl %%ebp"
+                     : "=a"(ret)
+                     : "a"(n), "b"(a), "c"(b), "d"(c), "S"(d), "D"(e), "m"(f)
+                     : "memory");
+    return ret;
+}
+
+#define linux_syscall(n, a, b, c) \
+    linux_syscall6((n), (int)(a), (int)(b), (int)(c), 0, 0, 0)
+
+/* Linux reports failure as -4095 .. -1 */
+#define LINUX_FAILED(ret) ((unsigned int)(ret) >= 0xfffff001u)
+
+/* thread table, see syscall.c */
+linux_thread_t *linux_thread_self(void);
+void linux_thread_root(void);
+void linux_install_signals(void);
+
+/* start time of get_ticks() */
+void linux_ticks_init(void);
+
+#endif /* _LINUX_SYSCALL_H */
@@ -0,0 +1,623 @@
+/** @file syscall.c
+ *  @brief Pebbles system calls on top of Linux.
+ *
+ *  Each Pebbles thread is a Linux thread of one process. A thread has an
+ *  entry in a table, found from its Linux thread id through an index. The
+ *  entry is claimed by thread_fork() before clone(); Linux writes the
+ *  thread id into it when the child starts and clears it when the child
+ *  is gone, so a dead thread never keeps an entry.
+ *
+ *  deschedule() and make_runnable() flip a futex word of the entry, which
+ *  takes no lock. new_pages() maps anonymous memory at the exact address,
+ *  and remembers the length of each call for remove_pages(). swexn() is a
+ *  SIGSEGV (SIGBUS, SIGFPE, SIGILL) handler which runs on an alternate
+ *  signal stack and turns the signal frame into the ureg_t the Pebbles
+ *  kernel would push.
+ *
+ *  Only one task is emulated: fork(), exec() and wait() fail.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <stddef.h>
+#include <syscall.h>
+#include <ureg.h>
+#include <simics.h>
+#include "linux_syscall.h"
+
+/* threads alive in the task, vanish() ends the task when it hits 0 */
+int linux_live_threads = 1;
+int linux_exit_status;
+
+static int linux_pid;
+static int linux_start_ns[2];
+
+static linux_thread_t threads[LINUX_MAX_THREADS];
+/* entry + 1 of a thread id, 0 if none */
+static unsigned short thread_index[LINUX_TID_MAX];
+static int claim_hint;
+
+/* pages of each new_pages() call, indexed by its base page */
+static int region_pages[1 << 20];
+
+/* register layout of an i386 Linux signal frame */
+typedef struct {
+    unsigned int gs, fs, es, ds, edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    unsigned int trapno, err, eip, cs, eflags, esp_at_signal, ss;
+    unsigned int fpstate, oldmask, cr2;
+} linux_sigcontext_t;
+
+typedef struct {
+    unsigned int flags;
+    void *link;
+    void *ss_sp;
+    int ss_flags;
+    unsigned int ss_size;
+    linux_sigcontext_t mc;
+} linux_ucontext_t;
+
+typedef struct {
+    void *handler;
+    unsigned int flags;
+    void *restorer;
+    unsigned int mask[2];
+} linux_sigaction_t;
+
+#define SA_SIGINFO 0x4
+#define SA_ONSTACK 0x08000000
+#define SA_RESTORER 0x04000000
+#define SA_NODEFER 0x40000000
+
+/* flags of eflags a swexn() ureg may change */
+#define EFLAGS_USER 0xcd5u
+
+extern void linux_rt_sigreturn(void);
+
+/** @brief Find the entry of a thread
+ *
+ *  @param tid Linux thread id
+ *  @return the entry, NULL if the thread is not alive
+ */
+static linux_thread_t *linux_thread_find(int tid)
+{
+    int i;
+    linux_thread_t *t;
+
+    if(tid <= 0)
+        return NULL;
+
+    i = thread_index[tid & (LINUX_TID_MAX - 1)];
+    if(i == 0)
+        return NULL;
+
+    /* the index may be left over from a dead thread */
+    t = &threads[i - 1];
+    return t->tid == tid ? t : NULL;
+}
+
+/** @brief Index an entry by its thread id
+ *
+ *  @param t the entry
+ *  @param tid Linux thread id
+ *  @return Void
+ */
+static void linux_thread_index(linux_thread_t *t, int tid)
+{
+    thread_index[tid & (LINUX_TID_MAX - 1)] = t - threads + 1;
+}
+
+/** @brief Find the entry of the calling thread
+ *
+ *  @return the entry
+ */
+linux_thread_t *linux_thread_self(void)
+{
+    return linux_thread_find(linux_syscall(LINUX_NR_gettid, 0, 0, 0));
+}
+
+/** @brief Give the root thread an entry
+ *
+ *  @return Void
+ */
+void linux_thread_root(void)
+{
+    linux_thread_t *t = &threads[0];
+
+    linux_pid = linux_syscall(LINUX_NR_getpid, 0, 0, 0);
+    t->tid = linux_pid;
+    t->run = 1;
+    linux_thread_index(t, linux_pid);
+    claim_hint = 1;
+}
+
+/** @brief Claim a free entry for a new thread, called by thread_fork()
+ *
+ *  @return the thread id word Linux sets and clears, NULL if the table
+ *          is full
+ */
+int *linux_thread_claim(void)
+{
+    linux_thread_t *t;
+    int i, n;
+
+    i = claim_hint;
+    for(n = 0; n < LINUX_MAX_THREADS; n++, i = (i + 1) % LINUX_MAX_THREADS){
+        t = &threads[i];
+        if(t->tid == 0 && __sync_bool_compare_and_swap(&t->tid, 0, -1)){
+            t->run = 1;
+            t->eip = NULL;
+            t->pending = NULL;
+            claim_hint = (i + 1) % LINUX_MAX_THREADS;
+            return (int *)&t->tid;
+        }
+    }
+
+    return NULL;
+}
+
+/** @brief Finish thread_fork() in the parent
+ *
+ *  The child may have started, or even exited, already.
+ *
+ *  @param ctid the thread id word of the claimed entry
+ *  @param tid what clone() returned
+ *  @return Void
+ */
+void linux_thread_forked(int *ctid, int tid)
+{
+    linux_thread_t *t = (linux_thread_t *)ctid;
+
+    if(tid < 0){
+        t->tid = 0;
+        return;
+    }
+
+    /* make_runnable() may come before the child runs */
+    __sync_bool_compare_and_swap(&t->tid, -1, tid);
+    linux_thread_index(t, tid);
+}
+
+/** @brief Index the entry of a new thread, called by the child
+ *
+ *  @param ctid the thread id word, already set by Linux
+ *  @return Void
+ */
+void linux_thread_start(int *ctid)
+{
+    linux_thread_t *t = (linux_thread_t *)ctid;
+
+    linux_thread_index(t, t->tid);
+}
+
+int gettid(void)
+{
+    return linux_syscall(LINUX_NR_gettid, 0, 0, 0);
+}
+
+void set_status(int status)
+{
+    linux_exit_status = status;
+}
+
+void task_vanish(int status)
+{
+    while(1)
+        linux_syscall(LINUX_NR_exit_group, status, 0, 0);
+}
+
+/** @brief Yield to another thread
+ *
+ *  Linux can not run a given thread, so the caller just yields once the
+ *  thread is known to be runnable.
+ *
+ *  @param tid thread to run, -1 for any
+ *  @return 0 on success, -1 if the thread does not exist or is descheduled
+ */
+int yield(int tid)
+{
+    linux_thread_t *t;
+
+    if(tid != -1){
+        t = linux_thread_find(tid);
+        if(t == NULL || t->run == 0)
+            return -1;
+    }
+
+    linux_syscall(LINUX_NR_sched_yield, 0, 0, 0);
+    return 0;
+}
+
+/** @brief Deschedule the calling thread unless *reject is set
+ *
+ *  The run word is cleared before *reject is read, and make_runnable()
+ *  sets *reject before it looks at the run word, so a wakeup is never
+ *  lost.
+ *
+ *  @param reject checked after the thread is marked descheduled
+ *  @return 0
+ */
+int deschedule(int *reject)
+{
+    linux_thread_t *t = linux_thread_self();
+
+    __sync_lock_test_and_set(&t->run, 0);
+    if(*(volatile int *)reject){
+        t->run = 1;
+        return 0;
+    }
+
+    while(t->run == 0){
+        linux_syscall6(LINUX_NR_futex, (int)&t->run,
+                       LINUX_FUTEX_WAIT_PRIVATE, 0, 0, 0, 0);
+    }
+
+    return 0;
+}
+
+/** @brief Make a descheduled thread runnable
+ *
+ *  @param tid the thread
+ *  @return 0 on success, -1 if the thread is not descheduled
+ */
+int make_runnable(int tid)
+{
+    linux_thread_t *t = linux_thread_find(tid);
+
+    if(t == NULL || !__sync_bool_compare_and_swap(&t->run, 0, 1))
+        return -1;
+
+    linux_syscall(LINUX_NR_futex, &t->run, LINUX_FUTEX_WAKE_PRIVATE, 1);
+    return 0;
+}
+
+/** @brief Remember when the task started
+ *
+ *  @return Void
+ */
+void linux_ticks_init(void)
+{
+    linux_syscall(LINUX_NR_clock_gettime, LINUX_CLOCK_MONOTONIC,
+                  linux_start_ns, 0);
+}
+
+/** @brief Ticks since the task started
+ *
+ *  @return number of ticks
+ */
+int get_ticks(void)
+{
+    int ts[2];
+
+    linux_syscall(LINUX_NR_clock_gettime, LINUX_CLOCK_MONOTONIC, ts, 0);
+    return (ts[0] - linux_start_ns[0]) * (1000000000 / LINUX_TICK_NS) +
+           (ts[1] - linux_start_ns[1]) / LINUX_TICK_NS;
+}
+
+/** @brief Sleep for some ticks
+ *
+ *  @param ticks number of ticks
+ *  @return 0 on success, -1 if ticks is negative
+ */
+int sleep(int ticks)
+{
+    int ts[2];
+
+    if(ticks < 0)
+        return -1;
+
+    ts[0] = ticks / (1000000000 / LINUX_TICK_NS);
+    ts[1] = ticks % (1000000000 / LINUX_TICK_NS) * LINUX_TICK_NS;
+
+    /* a signal may cut the sleep short, the rest is written back */
+    while(linux_syscall(LINUX_NR_nanosleep, ts, ts, 0) < 0)
+        continue;
+
+    return 0;
+}
+
+int print(int size, char *buf)
+{
+    int ret;
+
+    if(size < 0)
+        return -1;
+
+    while(size > 0){
+        ret = linux_syscall(LINUX_NR_write, 1, buf, size);
+        if(ret <= 0)
+            return -1;
+        buf += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+char getchar(void)
+{
+    char c;
+
+    if(linux_syscall(LINUX_NR_read, 0, &c, 1) != 1)
+        return -1;
+    return c;
+}
+
+int readline(int size, char *buf)
+{
+    int ret = linux_syscall(LINUX_NR_read, 0, buf, size);
+
+    return ret < 0 ? -1 : ret;
+}
+
+/** @brief Map pages at an exact address
+ *
+ *  @param addr page aligned base
+ *  @param len bytes, a positive multiple of PAGE_SIZE
+ *  @return 0 on success, -1 if the range is bad, taken or out of memory
+ */
+int new_pages(void *addr, int len)
+{
+    int ret;
+
+    if(((unsigned int)addr & (PAGE_SIZE - 1)) || len <= 0 ||
+       (len & (PAGE_SIZE - 1)))
+        return -1;
+
+    /* any mapping in the range, ours or Linux', makes it fail */
+    ret = linux_syscall6(LINUX_NR_mmap2, (int)addr, len, LINUX_PROT_RW,
+                         LINUX_MAP_PRIVATE_ANON | LINUX_MAP_FIXED_NOREPLACE,
+                         -1, 0);
+    if(LINUX_FAILED(ret))
+        return -1;
+
+    /* a kernel without MAP_FIXED_NOREPLACE takes addr as a hint */
+    if((void *)ret != addr){
+        linux_syscall(LINUX_NR_munmap, ret, len, 0);
+        return -1;
+    }
+
+    region_pages[(unsigned int)addr / PAGE_SIZE] = len / PAGE_SIZE;
+    return 0;
+}
+
+/** @brief Unmap the pages of one new_pages() call
+ *
+ *  @param addr the base passed to new_pages()
+ *  @return 0 on success, -1 if addr is not such a base
+ */
+int remove_pages(void *addr)
+{
+    int pages;
+
+    if((unsigned int)addr & (PAGE_SIZE - 1))
+        return -1;
+
+    pages = __sync_lock_test_and_set(&region_pages[(unsigned int)addr /
+                                                   PAGE_SIZE], 0);
+    if(pages == 0)
+        return -1;
+
+    linux_syscall(LINUX_NR_munmap, addr, pages * PAGE_SIZE, 0);
+    return 0;
+}
+
+/** @brief Run the swexn handler of the faulting thread
+ *
+ *  Copy the registers into a ureg_t on the exception stack, and make the
+ *  signal return into the handler, as the Pebbles kernel does. The
+ *  handler is deregistered first.
+ *
+ *  @param sig signal number
+ *  @param info unused
+ *  @param uc the signal frame
+ *  @return Void
+ */
+static void linux_fault(int sig, void *info, linux_ucontext_t *uc)
+{
+    linux_thread_t *t = linux_thread_self();
+    linux_sigcontext_t *mc = &uc->mc;
+    unsigned int *frame;
+    ureg_t *ureg;
+
+    if(t == NULL || t->eip == NULL){
+        lprintf("thread %d killed: signal %d, eip 0x%x, address 0x%x",
+                gettid(), sig, mc->eip, mc->cr2);
+        task_vanish(-2);
+    }
+
+    ureg = (ureg_t *)((char *)t->esp3 - sizeof(ureg_t));
+    ureg->cause = mc->trapno;
+    ureg->cr2 = mc->cr2;
+    ureg->ds = mc->ds;
+    ureg->es = mc->es;
+    ureg->fs = mc->fs;
+    ureg->gs = mc->gs;
+    ureg->edi = mc->edi;
+    ureg->esi = mc->esi;
+    ureg->ebp = mc->ebp;
+    ureg->zero = 0;
+    ureg->ebx = mc->ebx;
+    ureg->edx = mc->edx;
+    ureg->ecx = mc->ecx;
+    ureg->eax = mc->eax;
+    ureg->error_code = mc->err;
+    ureg->eip = mc->eip;
+    ureg->cs = mc->cs;
+    ureg->eflags = mc->eflags;
+    ureg->esp = mc->esp;
+    ureg->ss = mc->ss;
+
+    /* handler(arg, ureg) called with a zero return address */
+    frame = (unsigned int *)ureg - 3;
+    frame[0] = 0;
+    frame[1] = (unsigned int)t->arg;
+    frame[2] = (unsigned int)ureg;
+
+    mc->eip = (unsigned int)t->eip;
+    mc->esp = (unsigned int)frame;
+    t->eip = NULL;
+}
+
+/** @brief Switch to the registers given to swexn()
+ *
+ *  @param sig signal number
+ *  @param info unused
+ *  @param uc the signal frame
+ *  @return Void
+ */
+static void linux_adopt(int sig, void *info, linux_ucontext_t *uc)
+{
+    linux_thread_t *t = linux_thread_self();
+    linux_sigcontext_t *mc = &uc->mc;
+    ureg_t *ureg = t->pending;
+
+    if(ureg == NULL)
+        return;
+    t->pending = NULL;
+
+    mc->edi = ureg->edi;
+    mc->esi = ureg->esi;
+    mc->ebp = ureg->ebp;
+    mc->ebx = ureg->ebx;
+    mc->edx = ureg->edx;
+    mc->ecx = ureg->ecx;
+    mc->eax = ureg->eax;
+    mc->eip = ureg->eip;
+    mc->esp = ureg->esp;
+    mc->eflags = (mc->eflags & ~EFLAGS_USER) | (ureg->eflags & EFLAGS_USER);
+}
+
+/** @brief Install a handler which runs on the alternate signal stack
+ *
+ *  @param sig signal number
+ *  @param handler the handler
+ *  @return Void
+ */
+static void linux_signal(int sig, void *handler)
+{
+    linux_sigaction_t sa;
+
+    sa.handler = handler;
+    sa.flags = SA_SIGINFO | SA_ONSTACK | SA_RESTORER | SA_NODEFER;
+    sa.restorer = linux_rt_sigreturn;
+    sa.mask[0] = 0;
+    sa.mask[1] = 0;
+    linux_syscall6(LINUX_NR_rt_sigaction, sig, (int)&sa, 0, 8, 0, 0);
+}
+
+/** @brief Install the handlers of faults and of swexn() register changes
+ *
+ *  @return Void
+ */
+void linux_install_signals(void)
+{
+    linux_signal(LINUX_SIGSEGV, linux_fault);
+    linux_signal(LINUX_SIGBUS, linux_fault);
+    linux_signal(LINUX_SIGFPE, linux_fault);
+    linux_signal(LINUX_SIGILL, linux_fault);
+    linux_signal(LINUX_SIGUSR2, linux_adopt);
+}
+
+/** @brief Register a software exception handler
+ *
+ *  A stack overflow can only be handled on another stack, so the first
+ *  call of a thread sets up the alternate signal stack of its entry. The
+ *  stack stays with the entry for the next thread.
+ *
+ *  New registers are adopted by a signal the thread sends itself, which
+ *  Linux delivers before the system call returns.
+ *
+ *  @param esp3 exception stack, NULL with eip NULL to deregister
+ *  @param eip handler
+ *  @param arg argument of the handler
+ *  @param newureg registers to return to, NULL to return normally
+ *  @return 0 on success, -1 on failure
+ */
+int swexn(void *esp3, swexn_handler_t eip, void *arg, ureg_t *newureg)
+{
+    linux_thread_t *t = linux_thread_self();
+    int ss[3];
+    int ret;
+
+    if(t->altstack_tid != t->tid){
+        if(t->altstack == NULL){
+            ret = linux_syscall6(LINUX_NR_mmap2, 0, LINUX_ALTSTACK_SIZE,
+                                 LINUX_PROT_RW, LINUX_MAP_PRIVATE_ANON,
+                                 -1, 0);
+            if(LINUX_FAILED(ret))
+                return -1;
+            t->altstack = (void *)ret;
+        }
+        ss[0] = (int)t->altstack;
+        ss[1] = 0;
+        ss[2] = LINUX_ALTSTACK_SIZE;
+        linux_syscall(LINUX_NR_sigaltstack, ss, 0, 0);
+        t->altstack_tid = t->tid;
+    }
+
+    if(esp3 != NULL && eip != NULL){
+        t->esp3 = esp3;
+        t->arg = arg;
+        t->eip = eip;
+    }
+    else
+        t->eip = NULL;
+
+    if(newureg != NULL){
+        t->pending = newureg;
+        linux_syscall(LINUX_NR_tgkill, linux_pid, t->tid, LINUX_SIGUSR2);
+    }
+
+    return 0;
+}
+
+/* a single task: there is nothing to fork, exec or wait for */
+
+int fork(void)
+{
+    return -1;
+}
+
+int exec(char *execname, char *argvec[])
+{
+    return -1;
+}
+
+int wait(int *status_ptr)
+{
+    return -1;
+}
+
+int set_term_color(int color)
+{
+    return 0;
+}
+
+int set_cursor_pos(int row, int col)
+{
+    return 0;
+}
+
+int get_cursor_pos(int *row, int *col)
+{
+    *row = 0;
+    *col = 0;
+    return 0;
+}
+
+void halt(void)
+{
+    task_vanish(0);
+}
+
+int ls(int size, char *buf)
+{
+    return -1;
+}
+
+void misbehave(int mode)
+{
+    return;
+}
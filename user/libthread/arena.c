@@ -0,0 +1,192 @@
+/** @file arena.c
+ *  @brief The implementation of the arena allocator.
+ *
+ *  A chunk has its header in front of the memory. When the current chunk
+ *  is full, a new one (larger if the request does not fit) is put at the
+ *  head of the chunk list. A bound arena is on the list of its thread, only
+ *  the thread itself touches the list.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+
+#include <thr_internals.h>
+#include <arena.h>
+
+#define ARENA_ALIGN(size) (((size) + 7) & ~7)
+
+static int arena_new_chunk(arena_t *arena, int size);
+static void arena_unbind(arena_t *arena);
+
+/** @brief Create an arena.
+ *
+ *
+ *  @param chunk_size the size of a chunk, 0 for ARENA_CHUNK_SIZE
+ *  @param flags ARENA_BIND_THREAD to bind the arena to the calling thread
+ *  @return the arena, NULL if fail.
+ */
+arena_t *arena_create(int chunk_size, int flags)
+{
+    thread_t *self = NULL;
+    arena_t *arena;
+
+    if(chunk_size < 0)
+        return NULL;
+
+    /* Only a thread of the library can be bound */
+    if((flags & ARENA_BIND_THREAD) && (self = get_self_thread()) == NULL)
+        return NULL;
+
+    if((arena = malloc(sizeof(arena_t))) == NULL)
+        return NULL;
+
+    arena->chunks = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+    arena->chunk_size = (chunk_size == 0) ? ARENA_CHUNK_SIZE : chunk_size;
+    arena->owner = self;
+    arena->next = NULL;
+
+    if(self != NULL){
+        arena->next = self->arenas;
+        self->arenas = arena;
+    }
+
+    return arena;
+}
+
+/** @brief Allocate memory from an arena.
+ *
+ *
+ *  @param arena the arena
+ *  @param size the size asked
+ *  @return the memory, NULL if out of memory.
+ */
+void *arena_alloc(arena_t *arena, int size)
+{
+    void *tmp;
+
+    /* keep the chunk size from overflowing */
+    if(size < 0 || size > 0x7fff0000)
+        return NULL;
+
+    size = ARENA_ALIGN(size);
+    if(arena->end - arena->ptr < size && arena_new_chunk(arena, size) < 0)
+        return NULL;
+
+    tmp = arena->ptr;
+    arena->ptr += size;
+
+    return tmp;
+}
+
+/** @brief Free all memory of an arena.
+ *
+ *  The current chunk is kept for the next allocations.
+ *
+ *  @param arena the arena
+ */
+void arena_reset(arena_t *arena)
+{
+    arena_chunk_t *chunk, *next;
+
+    if(arena->chunks == NULL)
+        return;
+
+    chunk = arena->chunks->next;
+    while(chunk != NULL){
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->chunks->next = NULL;
+    arena->ptr = (char *)(arena->chunks + 1);
+}
+
+/** @brief Destroy an arena.
+ *
+ *
+ *  @param arena the arena
+ */
+void arena_destroy(arena_t *arena)
+{
+    arena_chunk_t *chunk, *next;
+
+    if(arena == NULL)
+        return;
+
+    if(arena->owner != NULL)
+        arena_unbind(arena);
+
+    chunk = arena->chunks;
+    while(chunk != NULL){
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(arena);
+}
+
+/** @brief Destroy the arenas bound to an exiting thread.
+ *
+ *  Called by exit_thread().
+ *
+ *  @param thread the exiting thread
+ */
+void arena_thread_exit(thread_t *thread)
+{
+    while(thread->arenas != NULL)
+        arena_destroy(thread->arenas);
+}
+
+/** @brief Start a new chunk.
+ *
+ *  The rest of the current chunk is lost until the arena is reset.
+ *
+ *  @param arena the arena
+ *  @param size the size which must fit in the chunk
+ *  @return 0 on success, negative if out of memory.
+ */
+static int arena_new_chunk(arena_t *arena, int size)
+{
+    arena_chunk_t *chunk;
+    int chunk_size = arena->chunk_size;
+
+    if(size > chunk_size - (int)sizeof(arena_chunk_t))
+        chunk_size = size + sizeof(arena_chunk_t);
+
+    if((chunk = malloc(chunk_size)) == NULL)
+        return ERROR;
+
+    chunk->size = chunk_size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    arena->ptr = (char *)(chunk + 1);
+    arena->end = (char *)chunk + chunk_size;
+
+    return OK;
+}
+
+/** @brief Remove an arena from the list of its thread.
+ *
+ *  @param arena the arena
+ */
+static void arena_unbind(arena_t *arena)
+{
+    thread_t *owner = arena->owner;
+    arena_t **prev = &owner->arenas;
+
+    while(*prev != NULL && *prev != arena)
+        prev = &(*prev)->next;
+
+    if(*prev != NULL)
+        *prev = arena->next;
+
+    arena->owner = NULL;
+}
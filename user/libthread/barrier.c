@@ -0,0 +1,116 @@
+/** @file barrier.c
+ *
+ *  @brief barrier functions
+ *
+ *  Sense reversal: a thread reads the sense before it counts itself in, and
+ *  waits until the sense is flipped. The last thread of a phase resets the
+ *  count and flips the sense, so the barrier is ready for the next phase at
+ *  once. A waiter spins a little, then parks a wait node in the queue; the
+ *  last thread takes the whole queue and wakes everyone in one pass.
+ *
+ *  @author Qi Liu   (ID: qiliu)
+ *  @author Kaili Li (ID: kailili)
+ */
+
+#include <stddef.h>
+#include <syscall.h>
+#include <def.h>
+#include <barrier.h>
+#include <thr_internals.h>
+
+/* times a waiter checks the sense before it parks */
+#define BARRIER_SPIN_COUNT 64
+
+/** @brief init a barrier
+ *
+ * @param barrier: barrier
+ * @param n: number of threads of each phase
+ * @return error or success
+ **/
+int barrier_init(barrier_t *barrier, int n)
+{
+    if (n <= 0)
+        return ERROR;
+
+    barrier->n = n;
+    barrier->count = 0;
+    barrier->sense = 0;
+    barrier->qlock = 0;
+    linklist_init(&barrier->waitqueue);
+
+    return OK;
+}
+
+/** @brief wait at a barrier
+ *
+ * Block until n threads have called it in this phase.
+ *
+ * @param barrier: barrier
+ * @return BARRIER_SERIAL_THREAD for the last thread of the phase, 0 for the
+ *         others
+ **/
+int barrier_wait(barrier_t *barrier)
+{
+    waitnode_t waiter;
+    listnode_t *node, *next;
+    int sense = barrier->sense;
+    int i;
+
+    /* the last one lets everybody go */
+    if (barrier->n - 1 == atom_add(&barrier->count, 1)) {
+        barrier->count = 0;
+
+        waitq_lock(&barrier->qlock);
+        barrier->sense = !sense;
+        node = linklist_delall(&barrier->waitqueue);
+        waitq_unlock(&barrier->qlock);
+
+        /* a node is gone once its thread runs, get the next one first */
+        while (NULL != node) {
+            next = node->pNext;
+            waitnode_wakeup((waitnode_t *)node->data);
+            node = next;
+        }
+
+        return BARRIER_SERIAL_THREAD;
+    }
+
+    /* the phase may end soon */
+    for (i = 0; i < BARRIER_SPIN_COUNT; i++) {
+        if (barrier->sense != sense)
+            return 0;
+    }
+
+    waitnode_init(&waiter);
+
+    /* the sense is flipped with the queue lock held, no wakeup is lost */
+    waitq_lock(&barrier->qlock);
+    if (barrier->sense != sense) {
+        waitq_unlock(&barrier->qlock);
+        return 0;
+    }
+    linklist_addtail(&barrier->waitqueue, &waiter.node);
+    waitq_unlock(&barrier->qlock);
+
+    waitnode_sleep(&waiter);
+
+    return 0;
+}
+
+/** @brief destroy a barrier
+ *
+ * It is illegal to destroy a barrier while threads wait at it.
+ *
+ * @param barrier: barrier
+ * @return none
+ **/
+void barrier_destroy(barrier_t *barrier)
+{
+    /* the last thread of a phase may still be waking the others up */
+    while (0 != *(volatile int *)&barrier->qlock)
+        yield(-1);
+
+    barrier->n = 0;
+
+    return;
+}
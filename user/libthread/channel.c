@@ -0,0 +1,399 @@
+/** @file channel.c
+ *
+ *  @brief bounded channel functions
+ *
+ *  The ring buffer is the bounded MPMC queue of D. Vyukov. Each slot has a
+ *  sequence number: a sender may fill the slot for position pos when it is
+ *  pos, a receiver may empty it when it is pos + 1. A thread claims slots
+ *  by moving head (or tail) with one compare and exchange, so sending and
+ *  receiving take no lock. Several ready slots in a row are claimed at
+ *  once for the batched calls.
+ *
+ *  A thread which finds the channel full (empty) counts itself in the
+ *  waiters with the queue lock held, checks again and parks a wait node.
+ *  The other side publishes a slot with an atomic exchange (a full fence)
+ *  and then looks at the waiter count, so either the waiter sees the slot
+ *  or the other side sees the waiter and wakes it up.
+ *
+ *  @author Qi Liu   (ID: qiliu)
+ *  @author Kaili Li (ID: kailili)
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <syscall.h>
+#include <def.h>
+#include <channel.h>
+#include <thr_internals.h>
+
+/* tries before a thread parks */
+#define CHANNEL_SPIN_COUNT 16
+
+/* sides of a channel */
+#define CHANNEL_SEND 0
+#define CHANNEL_RECV 1
+
+static int channel_put(channel_t *ch, void **items, int n);
+static int channel_get(channel_t *ch, void **items, int n);
+static int channel_ready(channel_t *ch, int side);
+static void channel_park(channel_t *ch, int side);
+static void channel_wake(channel_t *ch, int side, int n);
+
+/** @brief init a channel
+ *
+ * @param ch: channel
+ * @param capacity: number of slots, rounded up to a power of 2
+ * @return error or success
+ **/
+int channel_init(channel_t *ch, int capacity)
+{
+    unsigned int size = 2;
+    unsigned int i;
+
+    if (capacity <= 0 || capacity > (1 << 24))
+        return ERROR;
+
+    while (size < (unsigned int)capacity)
+        size <<= 1;
+
+    if (NULL == (ch->cells = malloc(size * sizeof(channel_cell_t))))
+        return ERROR;
+
+    /* slot i is ready for a sender at position i */
+    for (i = 0; i < size; i++) {
+        ch->cells[i].seq = i;
+        ch->cells[i].item = NULL;
+    }
+
+    ch->mask = size - 1;
+    ch->head = 0;
+    ch->tail = 0;
+    ch->qlock = 0;
+    ch->send_waiters = 0;
+    ch->recv_waiters = 0;
+    linklist_init(&ch->send_queue);
+    linklist_init(&ch->recv_queue);
+
+    return OK;
+}
+
+/** @brief destroy a channel
+ *
+ * It is illegal to destroy a channel while threads use it.
+ *
+ * @param ch: channel
+ * @return none
+ **/
+void channel_destroy(channel_t *ch)
+{
+    /* a thread may still be waking others up */
+    while (0 != *(volatile int *)&ch->qlock)
+        yield(-1);
+
+    free(ch->cells);
+    ch->cells = NULL;
+
+    return;
+}
+
+/** @brief send an item
+ *
+ * @param ch: channel
+ * @param item: the item
+ * @return none
+ **/
+void channel_send(channel_t *ch, void *item)
+{
+    channel_send_n(ch, &item, 1);
+
+    return;
+}
+
+/** @brief receive an item
+ *
+ * @param ch: channel
+ * @return the item
+ **/
+void *channel_recv(channel_t *ch)
+{
+    void *item;
+
+    channel_recv_n(ch, &item, 1);
+
+    return item;
+}
+
+/** @brief send an item if the channel is not full
+ *
+ * @param ch: channel
+ * @param item: the item
+ * @return 0 if sent, negative if the channel is full
+ **/
+int channel_trysend(channel_t *ch, void *item)
+{
+    if (0 == channel_put(ch, &item, 1))
+        return ERROR;
+
+    channel_wake(ch, CHANNEL_RECV, 1);
+    return OK;
+}
+
+/** @brief receive an item if the channel is not empty
+ *
+ * @param ch: channel
+ * @param item: where to put the item
+ * @return 0 if received, negative if the channel is empty
+ **/
+int channel_tryrecv(channel_t *ch, void **item)
+{
+    if (0 == channel_get(ch, item, 1))
+        return ERROR;
+
+    channel_wake(ch, CHANNEL_SEND, 1);
+    return OK;
+}
+
+/** @brief send n items
+ *
+ * The items are sent in order; other senders' items may come in between
+ * when the channel fills up.
+ *
+ * @param ch: channel
+ * @param items: the items
+ * @param n: number of items
+ * @return none
+ **/
+void channel_send_n(channel_t *ch, void **items, int n)
+{
+    int done = 0, k, tries = 0;
+
+    while (done < n) {
+        k = channel_put(ch, items + done, n - done);
+        if (k > 0) {
+            done += k;
+            tries = 0;
+            channel_wake(ch, CHANNEL_RECV, k);
+        } else if (++tries > CHANNEL_SPIN_COUNT) {
+            channel_park(ch, CHANNEL_SEND);
+            tries = 0;
+        }
+    }
+
+    return;
+}
+
+/** @brief receive n items
+ *
+ * @param ch: channel
+ * @param items: where to put the items
+ * @param n: number of items
+ * @return none
+ **/
+void channel_recv_n(channel_t *ch, void **items, int n)
+{
+    int done = 0, k, tries = 0;
+
+    while (done < n) {
+        k = channel_get(ch, items + done, n - done);
+        if (k > 0) {
+            done += k;
+            tries = 0;
+            channel_wake(ch, CHANNEL_SEND, k);
+        } else if (++tries > CHANNEL_SPIN_COUNT) {
+            channel_park(ch, CHANNEL_RECV);
+            tries = 0;
+        }
+    }
+
+    return;
+}
+
+/** @brief claim up to n free slots in a row and fill them
+ *
+ * @param ch: channel
+ * @param items: the items
+ * @param n: number of items
+ * @return number of items sent, 0 if the channel is full
+ **/
+static int channel_put(channel_t *ch, void **items, int n)
+{
+    channel_cell_t *cell;
+    unsigned int pos, seq;
+    int i;
+
+    pos = ch->head;
+    while (1) {
+        for (i = 0; i < n; i++) {
+            seq = ch->cells[(pos + i) & ch->mask].seq;
+            if (seq != pos + i)
+                break;
+        }
+
+        if (i > 0) {
+            if (pos == (unsigned int)atom_cmpxchg((int *)&ch->head, pos,
+                                                  pos + i))
+                break;
+        } else if ((int)(seq - pos) < 0) {
+            /* the slot still holds the item of the last round */
+            return 0;
+        }
+
+        pos = ch->head;
+    }
+
+    n = i;
+    for (i = 0; i < n; i++) {
+        cell = &ch->cells[(pos + i) & ch->mask];
+        cell->item = items[i];
+        atom_xchg((int *)&cell->seq, pos + i + 1);
+    }
+
+    return n;
+}
+
+/** @brief claim up to n full slots in a row and empty them
+ *
+ * @param ch: channel
+ * @param items: where to put the items
+ * @param n: number of items
+ * @return number of items received, 0 if the channel is empty
+ **/
+static int channel_get(channel_t *ch, void **items, int n)
+{
+    channel_cell_t *cell;
+    unsigned int pos, seq;
+    int i;
+
+    pos = ch->tail;
+    while (1) {
+        for (i = 0; i < n; i++) {
+            seq = ch->cells[(pos + i) & ch->mask].seq;
+            if (seq != pos + i + 1)
+                break;
+        }
+
+        if (i > 0) {
+            if (pos == (unsigned int)atom_cmpxchg((int *)&ch->tail, pos,
+                                                  pos + i))
+                break;
+        } else if ((int)(seq - (pos + 1)) < 0) {
+            /* the slot has not been filled */
+            return 0;
+        }
+
+        pos = ch->tail;
+    }
+
+    n = i;
+    for (i = 0; i < n; i++) {
+        cell = &ch->cells[(pos + i) & ch->mask];
+        items[i] = cell->item;
+        atom_xchg((int *)&cell->seq, pos + i + ch->mask + 1);
+    }
+
+    return n;
+}
+
+/** @brief check if a side may go on
+ *
+ * A slot claimed by another thread meanwhile counts as ready, the caller
+ * tries again anyway.
+ *
+ * @param ch: channel
+ * @param side: CHANNEL_SEND or CHANNEL_RECV
+ * @return 1 if a slot is ready for the side, 0 if not
+ **/
+static int channel_ready(channel_t *ch, int side)
+{
+    unsigned int pos;
+
+    if (side == CHANNEL_SEND) {
+        pos = ch->head;
+        return (int)(ch->cells[pos & ch->mask].seq - pos) >= 0;
+    }
+
+    pos = ch->tail;
+    return (int)(ch->cells[pos & ch->mask].seq - (pos + 1)) >= 0;
+}
+
+/** @brief park the calling thread until the other side wakes it up
+ *
+ * Return at once if a slot got ready after the thread counted itself in.
+ *
+ * @param ch: channel
+ * @param side: CHANNEL_SEND or CHANNEL_RECV
+ * @return none
+ **/
+static void channel_park(channel_t *ch, int side)
+{
+    waitnode_t waiter;
+    int *waiters;
+    linklist_t *queue;
+
+    if (side == CHANNEL_SEND) {
+        waiters = (int *)&ch->send_waiters;
+        queue = &ch->send_queue;
+    } else {
+        waiters = (int *)&ch->recv_waiters;
+        queue = &ch->recv_queue;
+    }
+
+    waitnode_init(&waiter);
+
+    waitq_lock(&ch->qlock);
+    atom_add(waiters, 1);
+    if (channel_ready(ch, side)) {
+        atom_add(waiters, -1);
+        waitq_unlock(&ch->qlock);
+        return;
+    }
+    linklist_addtail(queue, &waiter.node);
+    waitq_unlock(&ch->qlock);
+
+    waitnode_sleep(&waiter);
+
+    return;
+}
+
+/** @brief wake up to n parked threads of a side
+ *
+ * @param ch: channel
+ * @param side: CHANNEL_SEND or CHANNEL_RECV
+ * @param n: number of threads
+ * @return none
+ **/
+static void channel_wake(channel_t *ch, int side, int n)
+{
+    listnode_t *ready = NULL;
+    listnode_t *node, *next;
+    linklist_t *queue;
+    int *waiters;
+
+    if (side == CHANNEL_SEND) {
+        waiters = (int *)&ch->send_waiters;
+        queue = &ch->send_queue;
+    } else {
+        waiters = (int *)&ch->recv_waiters;
+        queue = &ch->recv_queue;
+    }
+
+    /* nobody is waiting, the common case */
+    if (0 == *(volatile int *)waiters)
+        return;
+
+    waitq_lock(&ch->qlock);
+    while (n-- > 0 && NULL != (node = linklist_delhead(queue))) {
+        atom_add(waiters, -1);
+        node->pNext = ready;
+        ready = node;
+    }
+    waitq_unlock(&ch->qlock);
+
+    /* a node is gone once its thread runs, get the next one first */
+    for (node = ready; NULL != node; node = next) {
+        next = node->pNext;
+        waitnode_wakeup((waitnode_t *)node->data);
+    }
+
+    return;
+}
@@ -9,9 +9,9 @@
 #include<stddef.h>
 #include<def.h>
 #include<cond_type.h>
-#include<malloc.h>
 #include<syscall.h>
 #include<simics.h>
+#include<thr_internals.h>
 
 /** @brief init condition variables
  *  
@@ -89,23 +89,20 @@ void cond_destroy(cond_t *cv)
  **/
 void cond_wait(cond_t *cv, mutex_t *mp)
 {
-    listnode_t *pnode = NULL;
-    int flag          = 0;
+    waitnode_t waiter;
 
     /* cond var has been destroyed, do not use it */
     if (COND_DESTR_YES == cv->conddestr)
         return;
     
-    pnode = malloc(sizeof(listnode_t));
-        
-    /* init a node */
-    pnode->pNext = NULL;
-    pnode->data = (void *)gettid();
+    /* init a node, it lives on our stack until we are woken up */
+    waitnode_init(&waiter);
+    waiter.mp = mp;
 
     mutex_lock(&cv->condmutex);
 
     /* Insert into queue */
-    linklist_addtail(&cv->condqueue, pnode);
+    linklist_addtail(&cv->condqueue, &waiter.node);
 
     /* release world mutex */
     mutex_unlock(mp);
@@ -113,10 +110,11 @@ void cond_wait(cond_t *cv, mutex_t *mp)
    /* unlock queue */
     mutex_unlock(&cv->condmutex);
 
-    deschedule(&flag);
+    waitnode_sleep(&waiter);
 
-    /* lock the world mutex again */
-    mutex_lock(mp);
+    /* lock the world mutex again, unless it has been handed to us */
+    if (!waiter.locked)
+        mutex_lock(mp);
 
     return;
 }
@@ -131,15 +129,14 @@ void cond_wait(cond_t *cv, mutex_t *mp)
  **/
 void cond_signal(cond_t *cv)
 {
-    listnode_t *pnode = NULL;
-    int tid = 0;
+    waitnode_t *waiter = NULL;
     
     /* lock queue */
     mutex_lock(&cv->condmutex);
 
     /* delete from the queue head */
-    pnode = linklist_delhead(&cv->condqueue);
-    if (NULL == pnode) {
+    waiter = (waitnode_t *)linklist_delhead(&cv->condqueue);
+    if (NULL == waiter) {
         /* nobody in queue */
         mutex_unlock(&cv->condmutex);
         return;
@@ -148,13 +145,11 @@ void cond_signal(cond_t *cv)
     /* unlock queue */
     mutex_unlock(&cv->condmutex);
 
-    tid = (int)pnode->data;
-    /* make a thread runnable */
-    while (0 > make_runnable(tid))
-        yield(tid);
-    
-    /* free node space */
-    free(pnode);
+    /* 
+     * move it to the world mutex, it runs when it gets the mutex. The node 
+     * belongs to it again after that 
+     */
+    mutex_requeue(waiter->mp, waiter);
         
     return;
 }
@@ -165,6 +160,11 @@ void cond_signal(cond_t *cv)
  * pointed to by cv. Note that cond broadcast() should not awaken threads
  * which may invoke cond wait(cv) "after this call to cond broadcast()
  * has begun execution.
+ *
+ * The waiters are not made runnable at once, they would all run only to
+ * block on the world mutex again. Instead they are moved onto the wait queue
+ * of the mutex: if the mutex is free the first one gets it and runs, the rest
+ * run one by one as the mutex is handed to them.
  * 
  * @param cv: condition variable
  * @return none
@@ -179,16 +179,16 @@ void cond_broadcast(cond_t *cv)
     pnode = linklist_delall(&cv->condqueue);
     mutex_unlock(&cv->condmutex);
 
-    /* make runnable and free space one by one */
+    /* move to the world mutex one by one */
     while (NULL != pnode) {
-        /* make it runnable until succeed */
-        while (0 > make_runnable((int)pnode->data))
-            yield((int)pnode->data);
-
+        /* 
+         * the node is on the waiter's stack, get the next one before the 
+         * waiter runs again 
+         */
         tmppnode = pnode;
         pnode = pnode->pNext;
-        /* free node space */
-        free(tmppnode);     
+
+        mutex_requeue(((waitnode_t *)tmppnode)->mp, (waitnode_t *)tmppnode);
     }
 
     return;
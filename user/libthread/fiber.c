@@ -0,0 +1,426 @@
+/** @file fiber.c
+ *
+ *  @brief fiber functions
+ *
+ *  Fiber stacks are slots of an address range of their own, a guard page
+ *  and FIBER_STACK_PAGES pages each, with the fiber structure at the top.
+ *  So %esp tells whether the caller is a fiber, and which one, the way it
+ *  tells the thread for thread stacks. A slot is mapped the first time it
+ *  is used and kept: an ended fiber's slot goes to a small cache of its
+ *  thread, or to a shared free list when the cache is full.
+ *
+ *  A thread runs its fibers from fiber_run() on its own stack. It switches
+ *  to a fiber with fiber_switch() and the fiber switches back when it
+ *  yields, blocks or ends, telling why in its state. A fiber blocks from
+ *  waitnode_sleep(); whoever wakes it up may still find it running, so its
+ *  sleep word tells the thread whether it was woken before it got parked.
+ *  A parked fiber is woken by putting it in the wake queue of its thread,
+ *  under the queue lock, and waking the thread if it waits for one.
+ *
+ *  @author Qi Liu   (ID: qiliu)
+ *  @author Kaili Li (ID: kailili)
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <syscall.h>
+#include <def.h>
+#include <fiber.h>
+#include <thr_internals.h>
+
+/* Address range of the fiber stacks */
+#define FIBER_AREA_BASE 0x30000000
+#define FIBER_AREA_SIZE 0x10000000
+
+/* a stack and the guard page below it */
+#define FIBER_SLOT_SIZE ((FIBER_STACK_PAGES + 1) * PAGE_SIZE)
+#define FIBER_SLOTS (FIBER_AREA_SIZE / FIBER_SLOT_SIZE)
+
+/* the fiber structure sits at the top of its stack */
+#define FIBER_OF_SLOT(slot) \
+    ((fiber_t *)(FIBER_AREA_BASE + ((slot) + 1) * FIBER_SLOT_SIZE) - 1)
+
+/* why a fiber switched back to its thread */
+#define FIBER_YIELD 0
+#define FIBER_PARK 1
+#define FIBER_EXIT 2
+
+/* sleep word of a fiber */
+#define FIBER_RUNNING 0
+#define FIBER_WOKEN 1
+#define FIBER_PARKED 2
+
+void fiber_switch(void **save_esp, void *esp);
+
+/* slots of ended fibers no thread keeps */
+static int free_lock;
+static linklist_t free_slots;
+
+/* slots mapped so far */
+static int slots_used;
+
+static fiber_sched_t *fiber_sched_self(void);
+static fiber_t *fiber_next(fiber_sched_t *sched);
+static void fiber_idle(fiber_sched_t *sched);
+static void fiber_start(void);
+static void fiber_switch_out(fiber_t *fiber, int state);
+static fiber_t *fiber_alloc(fiber_sched_t *sched);
+static void fiber_free(fiber_sched_t *sched, fiber_t *fiber);
+
+/** @brief create a fiber run by the calling thread
+ *
+ * The fiber starts when the thread runs fiber_run(), or when the calling
+ * fiber switches out.
+ *
+ * @param func: the function
+ * @param arg: argument of the function
+ * @return error or success
+ **/
+int fiber_create(fiber_func_t func, void *arg)
+{
+    fiber_sched_t *sched;
+    fiber_t *fiber;
+    unsigned int *sp;
+
+    if (NULL == func || NULL == (sched = fiber_sched_self()))
+        return ERROR;
+
+    if (NULL == (fiber = fiber_alloc(sched)))
+        return ERROR;
+
+    fiber->sched = sched;
+    fiber->func = func;
+    fiber->arg = arg;
+    fiber->state = FIBER_YIELD;
+    fiber->sleep = FIBER_RUNNING;
+    fiber->node.pNext = NULL;
+    fiber->node.data = (void *)fiber;
+
+    /* the stack looks as if fiber_start() had switched away */
+    sp = (unsigned int *)((unsigned int)fiber & ~15);
+    *--sp = 0;                          /* return address of fiber_start() */
+    *--sp = (unsigned int)fiber_start;
+    *--sp = 0;                          /* %ebp */
+    *--sp = 0;                          /* %ebx */
+    *--sp = 0;                          /* %esi */
+    *--sp = 0;                          /* %edi */
+    fiber->esp = (void *)sp;
+
+    sched->nfibers++;
+    linklist_addtail(&sched->run_queue, &fiber->node);
+
+    return OK;
+}
+
+/** @brief run the fibers of the calling thread until they all end
+ *
+ * @return error if called from a fiber or before thr_init(), or success
+ **/
+int fiber_run(void)
+{
+    fiber_sched_t *sched;
+    thread_t *thread;
+    fiber_t *fiber;
+    listnode_t *node;
+    int old;
+
+    if (NULL != fiber_self() || NULL == (thread = get_self_thread()))
+        return ERROR;
+
+    if (NULL == (sched = thread->fiber_sched))
+        return OK;
+
+    while (sched->nfibers > 0) {
+        if (NULL == (fiber = fiber_next(sched))) {
+            fiber_idle(sched);
+            continue;
+        }
+
+        fiber_switch(&sched->esp, fiber->esp);
+
+        switch (fiber->state) {
+        case FIBER_YIELD:
+            fiber->node.pNext = NULL;
+            linklist_addtail(&sched->run_queue, &fiber->node);
+            break;
+        case FIBER_PARK:
+            /* it may have been woken up before it got here */
+            old = atom_cmpxchg((int *)&fiber->sleep, FIBER_RUNNING,
+                               FIBER_PARKED);
+            if (FIBER_WOKEN == old) {
+                fiber->sleep = FIBER_RUNNING;
+                fiber->node.pNext = NULL;
+                linklist_addtail(&sched->run_queue, &fiber->node);
+            }
+            break;
+        default:
+            sched->nfibers--;
+            fiber_free(sched, fiber);
+            break;
+        }
+    }
+
+    /* give the cached stacks to the other threads */
+    waitq_lock(&free_lock);
+    while (NULL != (node = linklist_delhead(&sched->cache))) {
+        node->pNext = NULL;
+        linklist_addtail(&free_slots, node);
+    }
+    waitq_unlock(&free_lock);
+
+    /* a thread may still be waking the last fiber up */
+    while (0 != *(volatile int *)&sched->qlock)
+        yield(-1);
+
+    thread->fiber_sched = NULL;
+    free(sched);
+
+    return OK;
+}
+
+/** @brief let the next ready fiber of the thread run
+ *
+ * @return none
+ **/
+void fiber_yield(void)
+{
+    fiber_t *fiber = fiber_self();
+
+    if (NULL != fiber)
+        fiber_switch_out(fiber, FIBER_YIELD);
+
+    return;
+}
+
+/** @brief get the calling fiber
+ *
+ * @return the fiber, NULL if the caller does not run on a fiber stack
+ **/
+fiber_t *fiber_self(void)
+{
+    unsigned int offset = (unsigned int)&offset - FIBER_AREA_BASE;
+
+    if (offset >= FIBER_AREA_SIZE)
+        return NULL;
+
+    return FIBER_OF_SLOT(offset / FIBER_SLOT_SIZE);
+}
+
+/** @brief block the calling fiber until it is woken up
+ *
+ * @param fiber: the calling fiber
+ * @return none
+ **/
+void fiber_park(fiber_t *fiber)
+{
+    fiber_switch_out(fiber, FIBER_PARK);
+
+    return;
+}
+
+/** @brief wake up a blocked fiber
+ *
+ * @param fiber: the fiber, blocked or about to block
+ * @return none
+ **/
+void fiber_wake(fiber_t *fiber)
+{
+    fiber_sched_t *sched = fiber->sched;
+    waitnode_t *idle;
+
+    /* not parked yet, its thread puts it back in the run queue */
+    if (FIBER_RUNNING == atom_cmpxchg((int *)&fiber->sleep, FIBER_RUNNING,
+                                      FIBER_WOKEN))
+        return;
+
+    fiber->sleep = FIBER_RUNNING;
+    fiber->node.pNext = NULL;
+
+    waitq_lock(&sched->qlock);
+    linklist_addtail(&sched->wake_queue, &fiber->node);
+    idle = sched->idle;
+    sched->idle = NULL;
+    waitq_unlock(&sched->qlock);
+
+    if (NULL != idle)
+        waitnode_wakeup(idle);
+
+    return;
+}
+
+/** @brief get the fibers of the calling thread, or fiber
+ *
+ * @return the fibers, NULL if the caller is not a thread of the library
+ *         or out of memory
+ **/
+static fiber_sched_t *fiber_sched_self(void)
+{
+    fiber_t *fiber = fiber_self();
+    fiber_sched_t *sched;
+    thread_t *thread;
+
+    if (NULL != fiber)
+        return fiber->sched;
+
+    if (NULL == (thread = get_self_thread()))
+        return NULL;
+
+    if (NULL != (sched = thread->fiber_sched))
+        return sched;
+
+    if (NULL == (sched = calloc(1, sizeof(fiber_sched_t))))
+        return NULL;
+
+    sched->thread = thread;
+    linklist_init(&sched->run_queue);
+    linklist_init(&sched->cache);
+    linklist_init(&sched->wake_queue);
+    thread->fiber_sched = sched;
+
+    return sched;
+}
+
+/** @brief take the next ready fiber
+ *
+ * Woken fibers join the run queue first, behind the fibers which yielded.
+ *
+ * @param sched: fibers of the calling thread
+ * @return the fiber, NULL if none is ready
+ **/
+static fiber_t *fiber_next(fiber_sched_t *sched)
+{
+    listnode_t *node, *next;
+
+    if (NULL != sched->wake_queue.pstfirst) {
+        waitq_lock(&sched->qlock);
+        node = linklist_delall(&sched->wake_queue);
+        waitq_unlock(&sched->qlock);
+
+        for (; NULL != node; node = next) {
+            next = node->pNext;
+            node->pNext = NULL;
+            linklist_addtail(&sched->run_queue, node);
+        }
+    }
+
+    if (NULL == (node = linklist_delhead(&sched->run_queue)))
+        return NULL;
+
+    return (fiber_t *)node->data;
+}
+
+/** @brief wait until a fiber of the thread is woken up
+ *
+ * @param sched: fibers of the calling thread
+ * @return none
+ **/
+static void fiber_idle(fiber_sched_t *sched)
+{
+    waitnode_t waiter;
+
+    waitnode_init(&waiter);
+
+    waitq_lock(&sched->qlock);
+    if (NULL != sched->wake_queue.pstfirst) {
+        waitq_unlock(&sched->qlock);
+        return;
+    }
+    sched->idle = &waiter;
+    waitq_unlock(&sched->qlock);
+
+    waitnode_sleep(&waiter);
+
+    return;
+}
+
+/** @brief the first function of a fiber, run its function and end it
+ *
+ * @return never
+ **/
+static void fiber_start(void)
+{
+    fiber_t *fiber = fiber_self();
+
+    fiber->func(fiber->arg);
+
+    /* the thread frees the stack once it is off it */
+    fiber_switch_out(fiber, FIBER_EXIT);
+}
+
+/** @brief switch from a fiber back to its thread
+ *
+ * @param fiber: the calling fiber
+ * @param state: why
+ * @return none
+ **/
+static void fiber_switch_out(fiber_t *fiber, int state)
+{
+    fiber->state = state;
+    fiber_switch(&fiber->esp, fiber->sched->esp);
+
+    return;
+}
+
+/** @brief get a stack slot for a fiber
+ *
+ * @param sched: fibers of the calling thread
+ * @return the fiber at the top of the slot, NULL if out of slots or pages
+ **/
+static fiber_t *fiber_alloc(fiber_sched_t *sched)
+{
+    listnode_t *node;
+    fiber_t *fiber;
+    char *base;
+    int slot;
+
+    if (NULL != (node = linklist_delhead(&sched->cache))) {
+        sched->ncached--;
+        return (fiber_t *)node->data;
+    }
+
+    waitq_lock(&free_lock);
+    node = linklist_delhead(&free_slots);
+    waitq_unlock(&free_lock);
+    if (NULL != node)
+        return (fiber_t *)node->data;
+
+    slot = atom_add(&slots_used, 1);
+    if (slot >= FIBER_SLOTS) {
+        atom_add(&slots_used, -1);
+        return NULL;
+    }
+
+    /* a slot whose pages can not be had is not used again */
+    base = (char *)FIBER_AREA_BASE + slot * FIBER_SLOT_SIZE + PAGE_SIZE;
+    if (new_pages(base, FIBER_STACK_PAGES * PAGE_SIZE) < 0)
+        return NULL;
+
+    fiber = FIBER_OF_SLOT(slot);
+    fiber->slot = slot;
+
+    return fiber;
+}
+
+/** @brief keep the stack slot of an ended fiber
+ *
+ * @param sched: fibers of the calling thread
+ * @param fiber: the fiber
+ * @return none
+ **/
+static void fiber_free(fiber_sched_t *sched, fiber_t *fiber)
+{
+    fiber->node.pNext = NULL;
+    fiber->node.data = (void *)fiber;
+
+    if (sched->ncached < FIBER_CACHE_MAX) {
+        linklist_addtail(&sched->cache, &fiber->node);
+        sched->ncached++;
+        return;
+    }
+
+    waitq_lock(&free_lock);
+    linklist_addtail(&free_slots, &fiber->node);
+    waitq_unlock(&free_lock);
+
+    return;
+}
@@ -0,0 +1,233 @@
+/** @file future.c
+ *
+ *  @brief future functions
+ *
+ *  A future is set in two steps: the setter claims it with a compare and
+ *  exchange, stores the result, then marks it ready and takes the parked
+ *  waiters with the queue lock held. A waiter checks the state and links
+ *  a wait node with the same lock held, so it is either told the result
+ *  is ready or taken by the setter.
+ *
+ *  A thread waiting on several futures links one list node into each of
+ *  them, all pointing to one wait node. Several setters may take it; the
+ *  first to flip its claimed flag wakes it up, the others drop it. Before
+ *  returning, the waiter takes each queue lock once more to unlink the
+ *  nodes left, so no setter holds one of its nodes afterwards.
+ *
+ *  @author Qi Liu   (ID: qiliu)
+ *  @author Kaili Li (ID: kailili)
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <syscall.h>
+#include <def.h>
+#include <future.h>
+#include <thr_internals.h>
+
+/* states of a future */
+#define FUTURE_EMPTY 0
+#define FUTURE_SETTING 1
+#define FUTURE_READY 2
+
+/* a thread waiting on one or more futures */
+typedef struct {
+    waitnode_t waiter;
+    volatile int claimed;   /* a setter is waking it up */
+} future_waiter_t;
+
+static int future_ready(future_t **futures, int n);
+
+/** @brief init a future
+ *
+ * @param future: future
+ * @return none
+ **/
+void future_init(future_t *future)
+{
+    future->state = FUTURE_EMPTY;
+    future->value = NULL;
+    future->qlock = 0;
+    linklist_init(&future->wait_queue);
+
+    return;
+}
+
+/** @brief destroy a future
+ *
+ * @param future: future
+ * @return none
+ **/
+void future_destroy(future_t *future)
+{
+    /* the setter may still be waking others up */
+    while (FUTURE_SETTING == future->state ||
+           0 != *(volatile int *)&future->qlock)
+        yield(-1);
+
+    return;
+}
+
+/** @brief set the result of a future
+ *
+ * @param future: future
+ * @param value: the result
+ * @return error if the future was set already, or success
+ **/
+int future_set(future_t *future, void *value)
+{
+    listnode_t *node, *next, *wake = NULL;
+    future_waiter_t *waiter;
+
+    if (FUTURE_EMPTY != atom_cmpxchg((int *)&future->state, FUTURE_EMPTY,
+                                     FUTURE_SETTING))
+        return ERROR;
+
+    future->value = value;
+
+    waitq_lock(&future->qlock);
+    future->state = FUTURE_READY;
+    node = linklist_delall(&future->wait_queue);
+    for (; NULL != node; node = next) {
+        next = node->pNext;
+        waiter = (future_waiter_t *)node->data;
+        if (0 == atom_xchg((int *)&waiter->claimed, 1)) {
+            node->pNext = wake;
+            wake = node;
+        }
+    }
+    waitq_unlock(&future->qlock);
+
+    /* a node is gone once its thread runs, get the next one first */
+    for (node = wake; NULL != node; node = next) {
+        next = node->pNext;
+        waiter = (future_waiter_t *)node->data;
+        waitnode_wakeup(&waiter->waiter);
+    }
+
+    return OK;
+}
+
+/** @brief get the result of a future, block until it is set
+ *
+ * @param future: future
+ * @return the result
+ **/
+void *future_get(future_t *future)
+{
+    /* waiting on one future takes no allocation and can not fail */
+    while (FUTURE_READY != future->state)
+        future_wait_any(&future, 1);
+
+    return future->value;
+}
+
+/** @brief get the result of a future without blocking
+ *
+ * @param future: future
+ * @param value: where to put the result
+ * @return error if the future is not set, or success
+ **/
+int future_try_get(future_t *future, void **value)
+{
+    if (FUTURE_READY != future->state)
+        return ERROR;
+
+    *value = future->value;
+
+    return OK;
+}
+
+/** @brief block until all futures are set
+ *
+ * @param futures: the futures
+ * @param n: number of futures
+ * @return error or success
+ **/
+int future_wait_all(future_t **futures, int n)
+{
+    int i;
+
+    if (NULL == futures || n <= 0)
+        return ERROR;
+
+    for (i = 0; i < n; i++)
+        future_get(futures[i]);
+
+    return OK;
+}
+
+/** @brief block until any of the futures is set
+ *
+ * @param futures: the futures
+ * @param n: number of futures
+ * @return the lowest index of a future set, or error
+ **/
+int future_wait_any(future_t **futures, int n)
+{
+    listnode_t stack_nodes[FUTURE_WAIT_NODES];
+    listnode_t *nodes = stack_nodes;
+    future_waiter_t waiter;
+    future_t *future;
+    int i, linked, ready;
+
+    if (NULL == futures || n <= 0)
+        return ERROR;
+
+    if (ERROR != (ready = future_ready(futures, n)))
+        return ready;
+
+    if (n > FUTURE_WAIT_NODES &&
+        NULL == (nodes = malloc(n * sizeof(listnode_t))))
+        return ERROR;
+
+    waitnode_init(&waiter.waiter);
+    waiter.claimed = 0;
+
+    for (linked = 0; linked < n; linked++) {
+        future = futures[linked];
+        waitq_lock(&future->qlock);
+        if (FUTURE_READY == future->state) {
+            waitq_unlock(&future->qlock);
+            break;
+        }
+        nodes[linked].pNext = NULL;
+        nodes[linked].data = (void *)&waiter;
+        linklist_addtail(&future->wait_queue, &nodes[linked]);
+        waitq_unlock(&future->qlock);
+    }
+
+    /* a setter which claimed the waiter is going to wake it up */
+    if (linked == n || 0 != atom_xchg((int *)&waiter.claimed, 1))
+        waitnode_sleep(&waiter.waiter);
+
+    for (i = 0; i < linked; i++) {
+        future = futures[i];
+        waitq_lock(&future->qlock);
+        linklist_del(&future->wait_queue, &nodes[i]);
+        waitq_unlock(&future->qlock);
+    }
+
+    if (nodes != stack_nodes)
+        free(nodes);
+
+    return future_ready(futures, n);
+}
+
+/** @brief find the first future set
+ *
+ * @param futures: the futures
+ * @param n: number of futures
+ * @return the lowest index of a future set, or error if none is set
+ **/
+static int future_ready(future_t **futures, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (FUTURE_READY == futures[i]->state)
+            return i;
+    }
+
+    return ERROR;
+}
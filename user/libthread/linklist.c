@@ -75,4 +75,35 @@ listnode_t* linklist_delall(linklist_t *pdellist)
     pdellist->pstlast = NULL; 
 
     return pnode;
-}
\ No newline at end of file
+}
+
+/** @brief delete a given node from a linklist
+ *  
+ *
+ * @param plist: linklist
+ * @param pnode: the node
+ * @return the pointer to deleted node, NULL if it is not in the linklist
+ **/
+listnode_t* linklist_del(linklist_t *plist, listnode_t *pnode)
+{
+    listnode_t *prev = NULL;
+    listnode_t *cur = plist->pstfirst;
+
+    while(NULL != cur && cur != pnode) {
+        prev = cur;
+        cur = cur->pNext;
+    }
+
+    if(NULL == cur)
+        return NULL;
+
+    if(NULL != prev)
+        prev->pNext = cur->pNext;
+    else
+        plist->pstfirst = cur->pNext;
+
+    if(plist->pstlast == cur)
+        plist->pstlast = prev;
+
+    return cur;
+}
@@ -1,24 +1,140 @@
 /** @file mallo.c
  *  @brief The implementation of malloc function family.
  *
- *  These functions should be thread safe. I use a mutex to protect the 
+ *  These functions should be thread safe. I use a mutex to protect the
  *  functions.
  *
+ *  Small blocks (up to 1024 bytes) are served from a per-thread cache, one
+ *  free list per size class, without any lock. The cache takes and gives
+ *  back blocks in batches from a shared depot, which is protected by the
+ *  mutex. A block freed by another thread is pushed onto the lock-free
+ *  remote list of the thread which owns it, the owner takes the whole list
+ *  when its cache is empty.
+ *
+ *  Each block has a header in front of it, with the size asked and the size
+ *  class and owner (stack slot) of the block. Medium blocks, and blocks
+ *  allocated before thr_init(), come from the shared heap under the mutex.
+ *
+ *  Large blocks (MALLOC_LARGE_MIN bytes and more) take whole pages from an
+ *  address range of their own: new_pages() when allocated, remove_pages()
+ *  when freed, so they are given back to the kernel. A bitmap of the range,
+ *  protected by its own mutex, tells which pages are taken and which pages
+ *  are the base of a new_pages() call. realloc() grows a large block in
+ *  place when the pages after it are free.
+ *
+ *  With MALLOC_STATS defined, the counters of malloc_stats.h are kept for
+ *  the library (with atomic adds) and for each thread (in its thread_t).
+ *  A wait for one of the mutexes is timed with get_ticks().
+ *
  *  @author Kaili Li (kailili)
  *  @author Qi Liu (qiliu)
  *  @bug No known bugs.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <types.h>
 #include <stddef.h>
+#include <string.h>
 #include <mutex.h>
 #include <syscall.h>
 
+#include <thr_internals.h>
+#include <malloc_stats.h>
+
 #include <simics.h>
 
 /* declare in mutex.c */
 extern mutex_t malloc_thread_mutex;
+extern mutex_t malloc_large_mutex;
+
+/* Size class of a block from the shared heap */
+#define MALLOC_CLASS_NONE 0xff
+
+/* Size class of a block from the large area */
+#define MALLOC_CLASS_LARGE 0xfe
+
+/* Blocks of this size (with the header) and more come from the large area */
+#define MALLOC_LARGE_MIN (PAGE_SIZE * 4)
+
+/* Address range of the large blocks */
+#define LARGE_AREA_BASE 0x50000000
+#define LARGE_AREA_PAGES 0x20000
+
+#define LARGE_PAGE_ADDR(page) ((char *)LARGE_AREA_BASE + (page) * PAGE_SIZE)
+#define LARGE_PAGES(size) \
+    (((size) + sizeof(malloc_header_t) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+/* Smallest size class, the others double it */
+#define MALLOC_CLASS_MIN 16
+
+/* Blocks moved between a cache and the depot at once */
+#define MALLOC_BATCH 16
+
+/* Blocks a cache keeps for one size class at most */
+#define MALLOC_CACHE_MAX (MALLOC_BATCH * 2)
+
+#define CLASS_SIZE(class) (MALLOC_CLASS_MIN << (class))
+
+/* Header in front of each block, keeps the block 8-byte aligned */
+typedef struct {
+    size_t size;    /* size asked by the user */
+    int info;       /* (owner slot << 8) | size class */
+} malloc_header_t;
+
+#define HEADER(buf) ((malloc_header_t *)(buf) - 1)
+#define INFO_CLASS(info) ((info) & 0xff)
+#define INFO_OWNER(info) ((info) >> 8)
+#define INFO_PAGES(info) ((info) >> 8)  /* pages of a large block */
+
+/* the next free block is kept in the block itself */
+#define NEXT_BLOCK(buf) (*(void **)(buf))
+
+/* shared depot of free small blocks, protected by malloc_thread_mutex */
+static void *depot_head[MALLOC_CLASSES];
+
+/* pages of the large area, protected by malloc_large_mutex */
+static unsigned int large_used[LARGE_AREA_PAGES / 32];  /* taken */
+static unsigned int large_base[LARGE_AREA_PAGES / 32];  /* new_pages() base */
+static int large_next = 0;    /* where the next search starts */
+
+static int size_class(size_t size);
+static void *cache_alloc(thread_t *self, int class);
+static void cache_free(thread_t *self, void *buf, int class);
+static int cache_refill(thread_t *self, int class);
+static void cache_drain_remote(thread_t *self);
+static void remote_free(void *buf, int owner);
+static void *heap_alloc(size_t size);
+static void *large_alloc(size_t size);
+static void large_free(void *buf);
+static int large_grow(void *buf, size_t size);
+static int large_find(int from, int npages);
+static void large_mark(int first, int npages, int used);
+
+#ifdef MALLOC_STATS
+
+static malloc_stats_t global_stats;
+
+static int stats_bucket(int info);
+static void stats_live(thread_t *self, int bytes);
+static void stats_alloc(void *buf);
+static void stats_free(void *buf);
+static void stats_resize(size_t old_size, size_t new_size);
+static void stats_lock(mutex_t *mp);
+
+#define MALLOC_LOCK(mp) stats_lock(mp)
+#define STATS_ALLOC(buf) stats_alloc(buf)
+#define STATS_FREE(buf) stats_free(buf)
+#define STATS_RESIZE(old_size, new_size) stats_resize(old_size, new_size)
+
+#else
+
+#define MALLOC_LOCK(mp) mutex_lock(mp)
+#define STATS_ALLOC(buf)
+#define STATS_FREE(buf)
+#define STATS_RESIZE(old_size, new_size)
+
+#endif /* MALLOC_STATS */
 
 /** @brief malloc() function.
  *
@@ -28,11 +144,27 @@ extern mutex_t malloc_thread_mutex;
  */
 void *malloc(size_t size)
 {
-    void *tmp = NULL;
-  
-    mutex_lock(&malloc_thread_mutex);
-    tmp = _malloc(size);
-    mutex_unlock(&malloc_thread_mutex);
+    thread_t *self;
+    void *tmp;
+    int class;
+
+    if(size >= MALLOC_LARGE_MIN - sizeof(malloc_header_t)){
+        tmp = large_alloc(size);
+    }else{
+        class = size_class(size);
+        self = get_self_thread();
+
+        /* Medium block, or no cache for the thread */
+        if(class == MALLOC_CLASS_NONE || self == NULL){
+            tmp = heap_alloc(size);
+        }else if((tmp = cache_alloc(self, class)) != NULL){
+            HEADER(tmp)->size = size;
+            HEADER(tmp)->info = (get_thread_index(self) << 8) | class;
+        }
+    }
+
+    if(tmp != NULL)
+        STATS_ALLOC(tmp);
 
     return tmp;
 }
@@ -47,10 +179,16 @@ void *malloc(size_t size)
 void *calloc(size_t nelt, size_t eltsize)
 {
     void *tmp = NULL;
-  
-    mutex_lock(&malloc_thread_mutex);
-    tmp = _calloc(nelt, eltsize);
-    mutex_unlock(&malloc_thread_mutex);
+    size_t size = nelt * eltsize;
+
+    /* overflow */
+    if(eltsize != 0 && size / eltsize != nelt)
+        return NULL;
+
+    /* Pages of a large block come zeroed from new_pages() */
+    if((tmp = malloc(size)) != NULL &&
+       INFO_CLASS(HEADER(tmp)->info) != MALLOC_CLASS_LARGE)
+        memset(tmp, 0, size);
 
     return tmp;
 }
@@ -65,23 +203,631 @@ void *calloc(size_t nelt, size_t eltsize)
 void *realloc(void *buf, size_t new_size)
 {
     void *tmp = NULL;
-  
-    mutex_lock(&malloc_thread_mutex);
-    tmp = _realloc(buf, new_size);
-    mutex_unlock(&malloc_thread_mutex);
+    malloc_header_t *header;
+#ifdef MALLOC_STATS
+    size_t old_size;
+#endif
+    int class;
+
+    if(buf == NULL)
+        return malloc(new_size);
+
+    if(new_size == 0){
+        free(buf);
+        return NULL;
+    }
+
+    header = HEADER(buf);
+    class = INFO_CLASS(header->info);
+#ifdef MALLOC_STATS
+    /* the size before the block is resized in place */
+    old_size = header->size;
+#endif
+
+    /* a large block fits, or grows in place */
+    if(class == MALLOC_CLASS_LARGE){
+        if(large_grow(buf, new_size) == OK){
+            STATS_RESIZE(old_size, new_size);
+            return buf;
+        }
+    }
+    /* still fits in the small block */
+    else if(class != MALLOC_CLASS_NONE && new_size <= CLASS_SIZE(class)){
+        header->size = new_size;
+        STATS_RESIZE(old_size, new_size);
+        return buf;
+    }
+
+    if((tmp = malloc(new_size)) == NULL)
+        return NULL;
+
+    memcpy(tmp, buf, (header->size < new_size) ? header->size : new_size);
+    free(buf);
 
     return tmp;
 }
 
 /** @brief free() function.
  *
- *  @param buf the address of the allocated memory  
+ *  @param buf the address of the allocated memory
  */
 void free(void *buf)
 {
-    mutex_lock(&malloc_thread_mutex);
-    _free(buf);
-    mutex_unlock(&malloc_thread_mutex);
-  
+    thread_t *self;
+    int info;
+
+    if(buf == NULL)
+        return;
+
+    STATS_FREE(buf);
+    info = HEADER(buf)->info;
+
+    if(INFO_CLASS(info) == MALLOC_CLASS_LARGE){
+        large_free(buf);
+        return;
+    }
+
+    /* Block from the shared heap */
+    if(INFO_CLASS(info) == MALLOC_CLASS_NONE){
+        MALLOC_LOCK(&malloc_thread_mutex);
+        _free(HEADER(buf));
+        mutex_unlock(&malloc_thread_mutex);
+        return;
+    }
+
+    /* Our own block goes to the cache, others to the remote list */
+    self = get_self_thread();
+    if(self != NULL && get_thread_index(self) == INFO_OWNER(info))
+        cache_free(self, buf, INFO_CLASS(info));
+    else
+        remote_free(buf, INFO_OWNER(info));
+
     return;
 }
+
+/** @brief Give back the blocks cached for an exiting thread.
+ *
+ *  Called by exit_thread(). Blocks freed to the thread later stay on its
+ *  remote list, the next thread on the stack slot takes them.
+ *
+ *  @param thread the exiting thread
+ */
+void malloc_thread_exit(thread_t *thread)
+{
+    malloc_cache_t *cache = &thread->malloc_cache;
+    void *buf;
+    int class;
+
+    cache_drain_remote(thread);
+
+    MALLOC_LOCK(&malloc_thread_mutex);
+    for(class = 0; class < MALLOC_CLASSES; class++){
+        while((buf = cache->head[class]) != NULL){
+            cache->head[class] = NEXT_BLOCK(buf);
+            NEXT_BLOCK(buf) = depot_head[class];
+            depot_head[class] = buf;
+        }
+        cache->count[class] = 0;
+    }
+    mutex_unlock(&malloc_thread_mutex);
+}
+
+/** @brief Get the size class of a size.
+ *
+ *  @param size the size asked
+ *  @return the size class, MALLOC_CLASS_NONE if it is too large.
+ */
+static int size_class(size_t size)
+{
+    int class = 0;
+
+    while(class < MALLOC_CLASSES && size > CLASS_SIZE(class))
+        class++;
+
+    return (class < MALLOC_CLASSES) ? class : MALLOC_CLASS_NONE;
+}
+
+/** @brief Take a block from the cache of the current thread.
+ *
+ *  @param self the current thread
+ *  @param class the size class
+ *  @return the block, NULL if out of memory.
+ */
+static void *cache_alloc(thread_t *self, int class)
+{
+    malloc_cache_t *cache = &self->malloc_cache;
+    void *buf;
+
+    if(cache->head[class] == NULL){
+        /* Take the blocks other threads have freed first */
+        if(cache->remote != NULL)
+            cache_drain_remote(self);
+
+        if(cache->head[class] == NULL && cache_refill(self, class) < 0)
+            return NULL;
+    }
+
+    buf = cache->head[class];
+    cache->head[class] = NEXT_BLOCK(buf);
+    cache->count[class]--;
+
+    return buf;
+}
+
+/** @brief Put a block into the cache of the current thread.
+ *
+ *  Give a batch back to the depot if the cache is too long.
+ *
+ *  @param self the current thread
+ *  @param buf the block
+ *  @param class the size class
+ */
+static void cache_free(thread_t *self, void *buf, int class)
+{
+    malloc_cache_t *cache = &self->malloc_cache;
+    void *tmp;
+    int i;
+
+    NEXT_BLOCK(buf) = cache->head[class];
+    cache->head[class] = buf;
+    cache->count[class]++;
+
+    if(cache->count[class] <= MALLOC_CACHE_MAX)
+        return;
+
+    MALLOC_LOCK(&malloc_thread_mutex);
+    for(i = 0; i < MALLOC_BATCH; i++){
+        tmp = cache->head[class];
+        cache->head[class] = NEXT_BLOCK(tmp);
+        NEXT_BLOCK(tmp) = depot_head[class];
+        depot_head[class] = tmp;
+    }
+    mutex_unlock(&malloc_thread_mutex);
+
+    cache->count[class] -= MALLOC_BATCH;
+}
+
+/** @brief Fill the cache with a batch of blocks.
+ *
+ *  Take them from the depot, or carve them from a new chunk of the shared
+ *  heap. The blocks of a chunk are never given back to the heap.
+ *
+ *  @param self the current thread
+ *  @param class the size class
+ *  @return 0 on success, negative if out of memory.
+ */
+static int cache_refill(thread_t *self, int class)
+{
+    malloc_cache_t *cache = &self->malloc_cache;
+    int block = sizeof(malloc_header_t) + CLASS_SIZE(class);
+    char *chunk;
+    void *buf;
+    int i;
+
+    MALLOC_LOCK(&malloc_thread_mutex);
+
+    for(i = 0; i < MALLOC_BATCH && (buf = depot_head[class]) != NULL; i++){
+        depot_head[class] = NEXT_BLOCK(buf);
+        NEXT_BLOCK(buf) = cache->head[class];
+        cache->head[class] = buf;
+    }
+
+    if(i == 0){
+        if((chunk = _malloc(block * MALLOC_BATCH)) == NULL){
+            mutex_unlock(&malloc_thread_mutex);
+            return ERROR;
+        }
+
+        for(i = 0; i < MALLOC_BATCH; i++){
+            buf = chunk + block * i + sizeof(malloc_header_t);
+            NEXT_BLOCK(buf) = cache->head[class];
+            cache->head[class] = buf;
+        }
+    }
+
+    mutex_unlock(&malloc_thread_mutex);
+
+    cache->count[class] += i;
+    return OK;
+}
+
+/** @brief Move the blocks freed by other threads into the cache.
+ *
+ *  Take the whole remote list at once, so a block can not be taken twice
+ *  (no ABA).
+ *
+ *  @param self the owner of the cache
+ */
+static void cache_drain_remote(thread_t *self)
+{
+    malloc_cache_t *cache = &self->malloc_cache;
+    void *buf, *next;
+    int class;
+
+    buf = (void *)atom_xchg((int *)&cache->remote, 0);
+    while(buf != NULL){
+        next = NEXT_BLOCK(buf);
+        class = INFO_CLASS(HEADER(buf)->info);
+
+        NEXT_BLOCK(buf) = cache->head[class];
+        cache->head[class] = buf;
+        cache->count[class]++;
+
+        buf = next;
+    }
+}
+
+/** @brief Push a block onto the remote list of its owner.
+ *
+ *  @param buf the block
+ *  @param owner index of the stack slot of the owner
+ */
+static void remote_free(void *buf, int owner)
+{
+    malloc_cache_t *cache = &get_thread_by_index(owner)->malloc_cache;
+    void *head;
+
+    do{
+        head = cache->remote;
+        NEXT_BLOCK(buf) = head;
+    }while(atom_cmpxchg((int *)&cache->remote, (int)head, (int)buf)
+           != (int)head);
+}
+
+/** @brief Allocate a block from the shared heap.
+ *
+ *  @param size the size asked
+ *  @return the address of the memory
+ */
+static void *heap_alloc(size_t size)
+{
+    malloc_header_t *header;
+
+    MALLOC_LOCK(&malloc_thread_mutex);
+    header = _malloc(sizeof(malloc_header_t) + size);
+    mutex_unlock(&malloc_thread_mutex);
+
+    if(header == NULL)
+        return NULL;
+
+    header->size = size;
+    header->info = MALLOC_CLASS_NONE;
+
+    return header + 1;
+}
+
+/** @brief Allocate a block from the large area.
+ *
+ *  Only the page search takes the mutex, not new_pages().
+ *
+ *  @param size the size asked
+ *  @return the address of the memory
+ */
+static void *large_alloc(size_t size)
+{
+    malloc_header_t *header;
+    int npages, first;
+
+    if(size > (LARGE_AREA_PAGES - 1) * PAGE_SIZE)
+        return NULL;
+    npages = LARGE_PAGES(size);
+
+    MALLOC_LOCK(&malloc_large_mutex);
+    if((first = large_find(large_next, npages)) < 0)
+        first = large_find(0, npages);
+    if(first >= 0){
+        large_mark(first, npages, 1);
+        large_next = first + npages;
+    }
+    mutex_unlock(&malloc_large_mutex);
+
+    if(first < 0)
+        return NULL;
+
+    header = (malloc_header_t *)LARGE_PAGE_ADDR(first);
+    if(new_pages(header, npages * PAGE_SIZE) < 0){
+        MALLOC_LOCK(&malloc_large_mutex);
+        large_mark(first, npages, 0);
+        mutex_unlock(&malloc_large_mutex);
+        return NULL;
+    }
+
+    header->size = size;
+    header->info = (npages << 8) | MALLOC_CLASS_LARGE;
+
+    return header + 1;
+}
+
+/** @brief Give a large block back to the kernel.
+ *
+ *  The pages are marked free after they are removed, so nobody maps them
+ *  again before that.
+ *
+ *  @param buf the block
+ */
+static void large_free(void *buf)
+{
+    char *addr = (char *)HEADER(buf);
+    int first = (addr - LARGE_PAGE_ADDR(0)) / PAGE_SIZE;
+    int npages = INFO_PAGES(HEADER(buf)->info);
+    int page;
+
+    /* Only this thread changes the bits of the block's pages */
+    for(page = first; page < first + npages; page++){
+        if(large_base[page / 32] & (1u << (page % 32)))
+            remove_pages(LARGE_PAGE_ADDR(page));
+    }
+
+    MALLOC_LOCK(&malloc_large_mutex);
+    large_mark(first, npages, 0);
+    mutex_unlock(&malloc_large_mutex);
+}
+
+/** @brief Resize a large block in place.
+ *
+ *  A block keeps its pages when it shrinks. It grows if the pages after it
+ *  are free; the new pages are another new_pages() call.
+ *
+ *  @param buf the block
+ *  @param size the new size
+ *  @return 0 on success, negative if the block can not grow in place.
+ */
+static int large_grow(void *buf, size_t size)
+{
+    malloc_header_t *header = HEADER(buf);
+    int first = ((char *)header - LARGE_PAGE_ADDR(0)) / PAGE_SIZE;
+    int npages = INFO_PAGES(header->info);
+    int need;
+
+    if(size > (LARGE_AREA_PAGES - 1) * PAGE_SIZE)
+        return ERROR;
+
+    need = LARGE_PAGES(size);
+    if(need <= npages){
+        header->size = size;
+        return OK;
+    }
+
+    if(first + need > LARGE_AREA_PAGES)
+        return ERROR;
+
+    /* The pages after the block are free if the first free run is there */
+    MALLOC_LOCK(&malloc_large_mutex);
+    if(large_find(first + npages, need - npages) != first + npages){
+        mutex_unlock(&malloc_large_mutex);
+        return ERROR;
+    }
+    large_mark(first + npages, need - npages, 1);
+    mutex_unlock(&malloc_large_mutex);
+
+    if(new_pages(LARGE_PAGE_ADDR(first + npages), 
+                 (need - npages) * PAGE_SIZE) < 0){
+        MALLOC_LOCK(&malloc_large_mutex);
+        large_mark(first + npages, need - npages, 0);
+        mutex_unlock(&malloc_large_mutex);
+        return ERROR;
+    }
+
+    header->size = size;
+    header->info = (need << 8) | MALLOC_CLASS_LARGE;
+
+    return OK;
+}
+
+/** @brief Search free pages in the large area.
+ *
+ *  Called with malloc_large_mutex held.
+ *
+ *  @param from the first page to look at
+ *  @param npages the number of pages
+ *  @return the first page of the first free run from there, negative if
+ *          not find.
+ */
+static int large_find(int from, int npages)
+{
+    int page, run = 0;
+
+    for(page = from; page < LARGE_AREA_PAGES; page++){
+        /* skip a word of taken pages at once */
+        if(page % 32 == 0 && large_used[page / 32] == 0xffffffff){
+            run = 0;
+            page += 31;
+            continue;
+        }
+
+        if(large_used[page / 32] & (1u << (page % 32)))
+            run = 0;
+        else if(++run == npages)
+            return page - npages + 1;
+    }
+
+    return ERROR;
+}
+
+/** @brief Mark pages of the large area taken or free.
+ *
+ *  Called with malloc_large_mutex held. The first page of taken pages is
+ *  the base of their new_pages() call.
+ *
+ *  @param first the first page
+ *  @param npages the number of pages
+ *  @param used 1 if taken, 0 if free
+ */
+static void large_mark(int first, int npages, int used)
+{
+    int page;
+
+    for(page = first; page < first + npages; page++){
+        if(used)
+            large_used[page / 32] |= (1u << (page % 32));
+        else
+            large_used[page / 32] &= ~(1u << (page % 32));
+        large_base[page / 32] &= ~(1u << (page % 32));
+    }
+
+    if(used)
+        large_base[first / 32] |= (1u << (first % 32));
+}
+
+#ifdef MALLOC_STATS
+
+/** @brief Get a snapshot of the malloc counters.
+ *
+ *  The global counters are read one by one, they may be a little apart.
+ *
+ *  @param global the counters of the library, NULL if not needed
+ *  @param self the counters of the calling thread, NULL if not needed
+ *  @return 0 on success, negative if the caller is not a library thread.
+ */
+int malloc_stats(malloc_stats_t *global, malloc_stats_t *self)
+{
+    thread_t *thread;
+
+    if(global != NULL)
+        *global = global_stats;
+
+    if(self != NULL){
+        if((thread = get_self_thread()) == NULL)
+            return ERROR;
+        *self = thread->malloc_stats;
+    }
+
+    return OK;
+}
+
+/** @brief Print the malloc counters of the library and the calling thread.
+ *
+ */
+void malloc_stats_dump(void)
+{
+    malloc_stats_t stats[2];
+    char buf[256];
+    int i, len;
+
+    if(malloc_stats(&stats[0], &stats[1]) < 0)
+        memset(&stats[1], 0, sizeof(malloc_stats_t));
+
+    for(i = 0; i < 2; i++){
+        len = snprintf(buf, sizeof(buf), 
+            "malloc %s: live %d peak %d frees %d wait %d/%d ticks\n"
+            "  allocs 16:%d 32:%d 64:%d 128:%d 256:%d 512:%d 1k:%d "
+            "med:%d large:%d\n",
+            (i == 0) ? "all" : "self", stats[i].bytes_live, 
+            stats[i].bytes_peak, stats[i].frees, stats[i].contended, 
+            stats[i].wait_ticks, stats[i].allocs[0], stats[i].allocs[1], 
+            stats[i].allocs[2], stats[i].allocs[3], stats[i].allocs[4], 
+            stats[i].allocs[5], stats[i].allocs[6], 
+            stats[i].allocs[MALLOC_STATS_MEDIUM], 
+            stats[i].allocs[MALLOC_STATS_LARGE]);
+        print((len < (int)sizeof(buf)) ? len : (int)sizeof(buf) - 1, buf);
+    }
+}
+
+/** @brief Get the statistics bucket of a block.
+ *
+ *  @param info the info of the block header
+ *  @return the bucket
+ */
+static int stats_bucket(int info)
+{
+    if(INFO_CLASS(info) == MALLOC_CLASS_LARGE)
+        return MALLOC_STATS_LARGE;
+    if(INFO_CLASS(info) == MALLOC_CLASS_NONE)
+        return MALLOC_STATS_MEDIUM;
+    return INFO_CLASS(info);
+}
+
+/** @brief Add bytes to the live bytes of the library and the thread.
+ *
+ *  @param self the current thread, NULL if none
+ *  @param bytes the bytes, negative if freed
+ */
+static void stats_live(thread_t *self, int bytes)
+{
+    int live, peak;
+
+    live = atom_add(&global_stats.bytes_live, bytes) + bytes;
+    do{
+        peak = global_stats.bytes_peak;
+    }while(live > peak && 
+           atom_cmpxchg(&global_stats.bytes_peak, peak, live) != peak);
+
+    if(self != NULL){
+        self->malloc_stats.bytes_live += bytes;
+        if(self->malloc_stats.bytes_live > self->malloc_stats.bytes_peak)
+            self->malloc_stats.bytes_peak = self->malloc_stats.bytes_live;
+    }
+}
+
+/** @brief Count an allocated block.
+ *
+ *  @param buf the block
+ */
+static void stats_alloc(void *buf)
+{
+    thread_t *self = get_self_thread();
+    int bucket = stats_bucket(HEADER(buf)->info);
+
+    atom_add(&global_stats.allocs[bucket], 1);
+    if(self != NULL)
+        self->malloc_stats.allocs[bucket]++;
+
+    stats_live(self, HEADER(buf)->size);
+}
+
+/** @brief Count a freed block.
+ *
+ *  @param buf the block
+ */
+static void stats_free(void *buf)
+{
+    thread_t *self = get_self_thread();
+
+    atom_add(&global_stats.frees, 1);
+    if(self != NULL)
+        self->malloc_stats.frees++;
+
+    stats_live(self, -(int)HEADER(buf)->size);
+}
+
+/** @brief Count a block resized in place.
+ *
+ *  @param old_size the size before
+ *  @param new_size the size after
+ */
+static void stats_resize(size_t old_size, size_t new_size)
+{
+    stats_live(get_self_thread(), (int)new_size - (int)old_size);
+}
+
+/** @brief Lock a malloc mutex, time the wait if it is held.
+ *
+ *  The mutex may be released between the check and mutex_lock(), then a
+ *  wait of no ticks is counted.
+ *
+ *  @param mp the mutex
+ */
+static void stats_lock(mutex_t *mp)
+{
+    thread_t *self;
+    int ticks;
+
+    /* 0 is unlocked, see mutex.c */
+    if(*(volatile int *)&mp->lock == 0){
+        mutex_lock(mp);
+        return;
+    }
+
+    ticks = get_ticks();
+    mutex_lock(mp);
+    ticks = get_ticks() - ticks;
+
+    atom_add(&global_stats.contended, 1);
+    atom_add(&global_stats.wait_ticks, ticks);
+    if((self = get_self_thread()) != NULL){
+        self->malloc_stats.contended++;
+        self->malloc_stats.wait_ticks += ticks;
+    }
+}
+
+#endif /* MALLOC_STATS */
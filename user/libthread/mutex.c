@@ -1,7 +1,19 @@
 /** @file mutex.c.
  *  @brief The implementation of mutex.
  *
- *  How do you implement
+ *  The lock word has three states: unlocked, locked, and locked with 
+ *  (possible) waiters. An uncontended lock and unlock are a single atomic
+ *  compare and exchange each, with no system call.
+ *
+ *  When the lock is taken, a thread retries a bounded number of times, then 
+ *  puts a wait node on its own stack into the wait queue of the mutex and 
+ *  deschedules itself. mutex_unlock() only goes to the wait queue if the lock 
+ *  word says there are waiters, and then hands the mutex directly to the 
+ *  first waiter and makes it runnable.
+ *
+ *  A thread woken from a condition variable is moved onto the wait queue of 
+ *  the mutex (mutex_requeue()) instead of being made runnable, so it only runs
+ *  when the mutex is handed to it.
  *  
  *  @author Kaili Li (kailili)
  *  @author Qi Liu (qiliu)
@@ -12,55 +24,36 @@
 #include<def.h>
 #include<stddef.h>
 #include<mutex_type.h>
+#include<thr_internals.h>
 
 /* mutex has been destroyed or not */
 #define MUTEX_DESTR_YES 1
 #define MUTEX_DESTR_NO 0
      
-/* mutex has been locked by a thread or not */
-#define MUTEX_LOCK_YES 0
-#define MUTEX_LOCK_NO 1
-
-/* Atomic add or dec an integer */
-#define ADD_LOCK_NUM(M_mutex) \
-{\
-    while (MUTEX_LOCK_NO != atom_xchg(&((M_mutex)->countlock), MUTEX_LOCK_YES))\
-        yield(-1);\
-    (M_mutex)->inmutex_count++;\
-    (M_mutex)->countlock = MUTEX_LOCK_NO;\
-}
+/* state of the lock word */
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1
+#define MUTEX_CONTENDED 2
 
-#define DEC_LOCK_NUM(M_mutex) \
-{\
-    while (MUTEX_LOCK_NO != atom_xchg(&((M_mutex)->countlock), MUTEX_LOCK_YES))\
-        yield(-1);\
-    (M_mutex)->inmutex_count--;\
-    (M_mutex)->countlock = MUTEX_LOCK_NO;\
-}
+/* times to retry before blocking, 0 to block at once */
+#define MUTEX_SPIN_COUNT 64
 
-/* Atomic test whether an integer is zero */
-#define LOCK_NUM_TEST(M_mutex) \
-{\
-    while (MUTEX_LOCK_NO != atom_xchg(&((M_mutex)->countlock), MUTEX_LOCK_YES))\
-        yield(-1);\
-    if (0 != (M_mutex)->inmutex_count) { \
-        (M_mutex)->countlock = MUTEX_LOCK_NO;\
-        yield((M_mutex)->thread);\
-    } \
-    else{ \
-        (M_mutex)->countlock = MUTEX_LOCK_NO;\
-        break; \
-    }\
-}
- 
-extern int atom_xchg(int *, int);
+/* read the lock word without caching it in a register */
+#define MUTEX_STATE(M_mutex) (*(volatile int *)&((M_mutex)->lock))
 
 /* used in malloc.c */
-mutex_t malloc_thread_mutex = { .lock = MUTEX_LOCK_NO,
+mutex_t malloc_thread_mutex = { .lock = MUTEX_UNLOCKED,
                                 .thread = INVALID_THREAD, 
                                 .destroy = MUTEX_DESTR_NO,
-                                .inmutex_count = 0,
-                                .countlock = MUTEX_LOCK_NO};
+                                .qlock = 0,
+                                .waitqueue = { NULL, NULL } };
+
+/* used in malloc.c, for large blocks */
+mutex_t malloc_large_mutex = { .lock = MUTEX_UNLOCKED,
+                               .thread = INVALID_THREAD, 
+                               .destroy = MUTEX_DESTR_NO,
+                               .qlock = 0,
+                               .waitqueue = { NULL, NULL } };
 
 /** @brief Initialize a mutex.
  *
@@ -71,16 +64,16 @@ mutex_t malloc_thread_mutex = { .lock = MUTEX_LOCK_NO,
 int mutex_init(mutex_t *mp)
 {  
     /* not lock */
-    mp->lock = MUTEX_LOCK_NO;
+    mp->lock = MUTEX_UNLOCKED;
     /* no thread get the mutex */
     mp->thread = INVALID_THREAD;
     
     /* mutex is initialize */
     mp->destroy = MUTEX_DESTR_NO;
     
-    /* no thread is using or waiting mutex_lock */
-    mp->inmutex_count = 0;
-    mp->countlock = MUTEX_LOCK_NO;
+    /* no thread is waiting for the mutex */
+    mp->qlock = 0;
+    linklist_init(&mp->waitqueue);
     
     return OK;
 }
@@ -98,10 +91,13 @@ void mutex_destroy(mutex_t *mp)
      */
     mp->destroy = MUTEX_DESTR_YES;
     
-    /* wait until no one is waiting or using the mutex_lock */
-    while(1) {
-        LOCK_NUM_TEST(mp);   
-    }
+    /* wait until no one is holding or waiting for the mutex */
+    while (MUTEX_UNLOCKED != MUTEX_STATE(mp))
+        yield(mp->thread);
+
+    /* an unlocker may still be releasing the queue lock */
+    while (0 != *(volatile int *)&mp->qlock)
+        yield(-1);
 }
 
 /** @brief Lock a mutex.
@@ -112,22 +108,47 @@ void mutex_destroy(mutex_t *mp)
  */
 void mutex_lock(mutex_t *mp)
 {
-    /* count the total number of threads who want to get the mutex */
-    ADD_LOCK_NUM(mp);
-    
+    waitnode_t waiter;
+    int i;
+
     /* if the mutex has been destroyed, do not lock it */
-    /* No need to recover the counter above, it is destroyed */
     if (MUTEX_DESTR_YES == mp->destroy)      
         return;
 
-    /* try to accquire mutex */
-    while (MUTEX_LOCK_NO != atom_xchg(&mp->lock, MUTEX_LOCK_YES)) 
-        /* yield to the thread who own the mutex */
-        yield (mp->thread);
-    
+    /* uncontended, get the mutex with one atomic operation */
+    if (MUTEX_UNLOCKED == atom_cmpxchg(&mp->lock, MUTEX_UNLOCKED, 
+                                       MUTEX_LOCKED)) {
+        mp->thread = get_self_tid();
+        return;
+    }
+
+    /* the owner may release it soon, retry a few times */
+    for (i = 0; i < MUTEX_SPIN_COUNT; i++) {
+        if (MUTEX_UNLOCKED == MUTEX_STATE(mp) &&
+            MUTEX_UNLOCKED == atom_cmpxchg(&mp->lock, MUTEX_UNLOCKED, 
+                                           MUTEX_LOCKED)) {
+            mp->thread = get_self_tid();
+            return;
+        }
+    }
+
+    waitnode_init(&waiter);
+
+    /* 
+     * mark the mutex contended, if it has just been released we get it,
+     * otherwise wait in the queue 
+     */
+    waitq_lock(&mp->qlock);
+    if (MUTEX_UNLOCKED == atom_xchg(&mp->lock, MUTEX_CONTENDED)) {
+        waitq_unlock(&mp->qlock);
+        mp->thread = waiter.tid;
+        return;
+    }
+    linklist_addtail(&mp->waitqueue, &waiter.node);
+    waitq_unlock(&mp->qlock);
 
-    /* get the mutex */
-    mp->thread = gettid();
+    /* the owner hands the mutex to us when it unlocks */
+    waitnode_sleep(&waiter);
             
     return;
 }
@@ -140,12 +161,64 @@ void mutex_lock(mutex_t *mp)
  */
 void mutex_unlock(mutex_t *mp)
 {   
+    waitnode_t *waiter;
+
     mp->thread = INVALID_THREAD;
     
-    /* the thread has finish using the mutex */
-    DEC_LOCK_NUM(mp);
+    /* nobody is waiting */
+    if (MUTEX_LOCKED == atom_cmpxchg(&mp->lock, MUTEX_LOCKED, MUTEX_UNLOCKED))
+        return;
+
+    /* hand the mutex to the first waiter */
+    waitq_lock(&mp->qlock);
+    waiter = (waitnode_t *)linklist_delhead(&mp->waitqueue);
+    if (NULL == waiter) {
+        mp->lock = MUTEX_UNLOCKED;
+        waitq_unlock(&mp->qlock);
+        return;
+    }
+
+    /* the lock stays held, by the waiter now */
+    if (NULL == mp->waitqueue.pstfirst)
+        mp->lock = MUTEX_LOCKED;
+    mp->thread = waiter->tid;
+    waitq_unlock(&mp->qlock);
+
+    waitnode_wakeup(waiter);
+
+    return;
+}
+
+/** @brief Move a thread woken from a condition variable onto the mutex.
+ *
+ *    Instead of making the thread runnable to contend for the mutex, put its
+ *  wait node into the wait queue of the mutex. It is woken up when the mutex 
+ *  is handed to it, or at once if the mutex is free now. Either way it holds 
+ *  the mutex when it runs.
+ *
+ *    @param mp the mutex the thread waits for
+ *    @param waiter wait node of the thread, not in any queue
+ *    @return none
+ */
+void mutex_requeue(mutex_t *mp, waitnode_t *waiter)
+{
+    waiter->node.pNext = NULL;
+    waiter->locked = 1;
+
+    waitq_lock(&mp->qlock);
+
+    /* the mutex is free, it is ours now, hand it to the waiter */
+    if (MUTEX_UNLOCKED == atom_xchg(&mp->lock, MUTEX_CONTENDED)) {
+        mp->lock = MUTEX_LOCKED;
+        mp->thread = waiter->tid;
+        waitq_unlock(&mp->qlock);
+
+        waitnode_wakeup(waiter);
+        return;
+    }
 
-    mp->lock = MUTEX_LOCK_NO;
+    linklist_addtail(&mp->waitqueue, &waiter->node);
+    waitq_unlock(&mp->qlock);
 
     return;
 }
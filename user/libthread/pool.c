@@ -0,0 +1,273 @@
+/** @file pool.c
+ *  @brief The implementation of the fixed-size object pool.
+ *
+ *  Slabs are allocated with new_pages() from an address range kept for the
+ *  pools, the next slab address is taken with an atomic add. A slab is cut
+ *  into objects which are never given back, so an object is always mapped
+ *  and the shared free list can read the next pointer of an object another
+ *  thread has just taken. The tag of the free list stops ABA.
+ *
+ *  Each thread keeps a free list of each pool in its thread_t, without any
+ *  lock. Objects move between it and the shared list in batches. An object
+ *  has no owner, it goes to the cache of the thread which frees it.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <syscall.h>
+
+#include <thr_internals.h>
+#include <pool.h>
+
+/* Address range of the slabs */
+#define POOL_AREA_BASE 0x40000000
+#define POOL_AREA_SIZE 0x10000000
+
+/* Bytes of a slab at least */
+#define POOL_SLAB_SIZE (PAGE_SIZE * 4)
+
+/* Objects moved between a cache and the shared list at once */
+#define POOL_BATCH 16
+
+/* Objects a cache keeps for one pool at most */
+#define POOL_CACHE_MAX (POOL_BATCH * 2)
+
+#define ALIGN_UP(size, align) (((size) + (align) - 1) & ~((align) - 1))
+
+/* the next free object is kept in the object itself */
+#define NEXT_OBJ(obj) (*(void **)(obj))
+
+static pool_t pools[POOL_MAX];
+static int pool_count = 0;
+
+/* offset of the next slab in the pool area */
+static int area_used = 0;
+
+static void *pool_pop(pool_t *pool);
+static void pool_push(pool_t *pool, void *obj);
+static int pool_refill(pool_t *pool, pool_cache_t *cache);
+static void *pool_new_slab(int size);
+
+/** @brief Create a pool.
+ *
+ *
+ *  @param objsize the size of an object
+ *  @return the pool, NULL if fail.
+ */
+pool_t *pool_create(int objsize)
+{
+    pool_t *pool;
+    int id;
+
+    if(objsize <= 0)
+        return NULL;
+
+    if((id = atom_add(&pool_count, 1)) >= POOL_MAX){
+        atom_add(&pool_count, -1);
+        return NULL;
+    }
+
+    /* Room for the next pointer, 8-byte aligned */
+    pool = &pools[id];
+    pool->objsize = ALIGN_UP(objsize, 8);
+    pool->id = id;
+    pool->free.head = NULL;
+    pool->free.tag = 0;
+
+    return pool;
+}
+
+/** @brief Allocate an object.
+ *
+ *
+ *  @param pool the pool
+ *  @return the object, NULL if out of memory.
+ */
+void *pool_alloc(pool_t *pool)
+{
+    pool_cache_t *cache;
+    thread_t *self;
+    void *obj;
+
+    /* No cache before thr_init() */
+    if((self = get_self_thread()) == NULL){
+        if((obj = pool_pop(pool)) == NULL && pool_refill(pool, NULL) == OK)
+            obj = pool_pop(pool);
+        return obj;
+    }
+
+    cache = &self->pool_cache;
+    if(cache->head[pool->id] == NULL && pool_refill(pool, cache) < 0)
+        return NULL;
+
+    obj = cache->head[pool->id];
+    cache->head[pool->id] = NEXT_OBJ(obj);
+    cache->count[pool->id]--;
+
+    return obj;
+}
+
+/** @brief Free an object of the pool.
+ *
+ *  Give a batch back to the shared list if the cache is too long.
+ *
+ *  @param pool the pool
+ *  @param obj the object
+ */
+void pool_free(pool_t *pool, void *obj)
+{
+    pool_cache_t *cache;
+    thread_t *self;
+    void *tmp;
+    int i;
+
+    if(obj == NULL)
+        return;
+
+    if((self = get_self_thread()) == NULL){
+        pool_push(pool, obj);
+        return;
+    }
+
+    cache = &self->pool_cache;
+    NEXT_OBJ(obj) = cache->head[pool->id];
+    cache->head[pool->id] = obj;
+    cache->count[pool->id]++;
+
+    if(cache->count[pool->id] <= POOL_CACHE_MAX)
+        return;
+
+    for(i = 0; i < POOL_BATCH; i++){
+        tmp = cache->head[pool->id];
+        cache->head[pool->id] = NEXT_OBJ(tmp);
+        pool_push(pool, tmp);
+    }
+    cache->count[pool->id] -= POOL_BATCH;
+}
+
+/** @brief Give back the objects cached for an exiting thread.
+ *
+ *  Called by exit_thread().
+ *
+ *  @param thread the exiting thread
+ */
+void pool_thread_exit(thread_t *thread)
+{
+    pool_cache_t *cache = &thread->pool_cache;
+    void *obj;
+    int id;
+
+    for(id = 0; id < pool_count && id < POOL_MAX; id++){
+        while((obj = cache->head[id]) != NULL){
+            cache->head[id] = NEXT_OBJ(obj);
+            pool_push(&pools[id], obj);
+        }
+        cache->count[id] = 0;
+    }
+}
+
+/** @brief Take an object from the shared list.
+ *
+ *  @param pool the pool
+ *  @return the object, NULL if the list is empty.
+ */
+static void *pool_pop(pool_t *pool)
+{
+    void *obj;
+    int tag;
+
+    do{
+        tag = pool->free.tag;
+        obj = pool->free.head;
+        if(obj == NULL)
+            return NULL;
+    }while(!atom_cmpxchg64(&pool->free, (int)obj, tag,
+                           (int)NEXT_OBJ(obj), tag + 1));
+
+    return obj;
+}
+
+/** @brief Put an object onto the shared list.
+ *
+ *  @param pool the pool
+ *  @param obj the object
+ */
+static void pool_push(pool_t *pool, void *obj)
+{
+    void *head;
+    int tag;
+
+    do{
+        tag = pool->free.tag;
+        head = pool->free.head;
+        NEXT_OBJ(obj) = head;
+    }while(!atom_cmpxchg64(&pool->free, (int)head, tag, (int)obj, tag + 1));
+}
+
+/** @brief Fill a cache with a batch of objects.
+ *
+ *  Take them from the shared list, or cut them from a new slab. Without a
+ *  cache, the objects of a new slab go to the shared list.
+ *
+ *  @param pool the pool
+ *  @param cache the cache, NULL for none
+ *  @return 0 on success, negative if out of memory.
+ */
+static int pool_refill(pool_t *pool, pool_cache_t *cache)
+{
+    int size, i, n;
+    char *slab;
+    void *obj;
+
+    if(cache != NULL){
+        for(i = 0; i < POOL_BATCH && (obj = pool_pop(pool)) != NULL; i++){
+            NEXT_OBJ(obj) = cache->head[pool->id];
+            cache->head[pool->id] = obj;
+        }
+        cache->count[pool->id] += i;
+        if(i > 0)
+            return OK;
+    }
+
+    size = ALIGN_UP(pool->objsize, POOL_SLAB_SIZE);
+    if((slab = pool_new_slab(size)) == NULL)
+        return ERROR;
+
+    n = size / pool->objsize;
+    for(i = 0; i < n; i++){
+        obj = slab + pool->objsize * i;
+        if(cache == NULL){
+            pool_push(pool, obj);
+            continue;
+        }
+        NEXT_OBJ(obj) = cache->head[pool->id];
+        cache->head[pool->id] = obj;
+    }
+    if(cache != NULL)
+        cache->count[pool->id] += n;
+
+    return OK;
+}
+
+/** @brief Allocate a slab in the pool area.
+ *
+ *  @param size the size of the slab, page aligned
+ *  @return the slab, NULL if fail.
+ */
+static void *pool_new_slab(int size)
+{
+    int offset;
+
+    /* The area is never given back, a failed slab leaves a hole */
+    offset = atom_add(&area_used, size);
+    if(offset < 0 || offset > POOL_AREA_SIZE - size)
+        return NULL;
+
+    if(new_pages((void *)(POOL_AREA_BASE + offset), size) < 0)
+        return NULL;
+
+    return (void *)(POOL_AREA_BASE + offset);
+}
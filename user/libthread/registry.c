@@ -0,0 +1,295 @@
+/** @file registry.c
+ *  @brief The implementation of registry functions.
+ *
+ *  The registry is an open addressing hash table with linear probing.
+ *
+ *  Lookups do not take any lock. Writers are serialized by a sequence lock;
+ *  one which moves keys makes readers retry their search. After a few 
+ *  failed tries the reader takes the writer mutex, so a descheduled writer
+ *  does not make readers spin.
+ *
+ *  A removed key is deleted by shifting the following entries back, so
+ *  there is no tombstone and churn does not make the table grow.
+ *
+ *  When the table is half full, a table twice as large replaces it. The old
+ *  table is kept on the retired list and never freed: a reader may still be
+ *  searching it. The retired tables take less memory than the current one.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+#include <def.h>
+
+#include <registry.h>
+
+/* Lock-free tries of a lookup before taking the writer mutex */
+#define REGISTRY_READ_TRIES 16
+
+/* home entry of a key, tids are mostly consecutive */
+#define REGISTRY_HOME(table, key) ((key) & ((table)->size - 1))
+
+static registry_table_t *create_registry_table(int size);
+static void registry_table_put(registry_table_t *table, int key, void *data);
+static int registry_table_find(registry_table_t *table, int key);
+static int registry_grow(registry_t *reg);
+
+/** @brief Initialize a registry.
+ *
+ *
+ *  @param reg the registry
+ *  @param size initial table size, rounded up to a power of 2
+ *  @return 0 on success, negative if fail.
+ */
+int registry_init(registry_t *reg, int size)
+{
+    int table_size = 1;
+
+    while(table_size < size)
+        table_size <<= 1;
+
+    if((reg->table = create_registry_table(table_size)) == NULL)
+        return ERROR;
+
+    return seqlock_init(&reg->lock);
+}
+
+/** @brief Insert a (key, data) pair in the registry.
+ *
+ *  Insert the key already in the registry, it will return error, not update
+ *  the registry.
+ *
+ *  @param reg the registry
+ *  @param key the key, must be positive
+ *  @param data the data
+ *  @return 0 on success, negative if fail.
+ */
+int registry_insert(registry_t *reg, int key, void *data)
+{
+    registry_table_t *table;
+
+    /*
+     * An insert only fills an empty entry, a reader can not miss other
+     * keys, so no need to change the sequence number.
+     */
+    seqlock_lock(&reg->lock);
+    table = reg->table;
+
+    /* The key exists, return error */
+    if(registry_table_find(table, key) >= 0){
+        seqlock_unlock(&reg->lock);
+        return ERROR;
+    }
+
+    /* Keep the table at most half full */
+    if((table->count + 1) * 2 > table->size){
+        if(registry_grow(reg) < 0){
+            seqlock_unlock(&reg->lock);
+            return ERROR;
+        }
+        table = reg->table;
+    }
+
+    registry_table_put(table, key, data);
+
+    seqlock_unlock(&reg->lock);
+    return OK;
+}
+
+/** @brief Remove a key from the registry.
+ *
+ *
+ *  @param reg the registry
+ *  @param key the key
+ *  @return 0 on success, negative if fail.
+ */
+int registry_remove(registry_t *reg, int key)
+{
+    registry_table_t *table;
+    registry_entry_t *entries;
+    int hole, next, home, mask;
+
+    /* Readers may miss a moving key from now on */
+    seqlock_write_begin(&reg->lock);
+    table = reg->table;
+    entries = table->entries;
+    mask = table->size - 1;
+
+    /* not find the key */
+    if((hole = registry_table_find(table, key)) < 0){
+        seqlock_write_end(&reg->lock);
+        return ERROR;
+    }
+
+    /*
+     * Shift back the entries after the hole which can not be found from
+     * their home entry any more.
+     */
+    next = hole;
+    while(1){
+        next = (next + 1) & mask;
+        if(entries[next].key == 0)
+            break;
+
+        home = REGISTRY_HOME(table, entries[next].key);
+
+        /* The home entry is cyclically in (hole, next], leave it */
+        if(hole <= next ? (hole < home && home <= next) :
+                          (hole < home || home <= next))
+            continue;
+
+        entries[hole].data = entries[next].data;
+        entries[hole].key = entries[next].key;
+        hole = next;
+    }
+    entries[hole].key = 0;
+    entries[hole].data = NULL;
+    table->count--;
+
+    seqlock_write_end(&reg->lock);
+    return OK;
+}
+
+/** @brief Search the data of a key in the registry.
+ *
+ *  Do not take any lock unless writers keep changing the table.
+ *
+ *  @param reg the registry
+ *  @param key the key
+ *  @return the data, NULL if not find.
+ */
+void *registry_lookup(registry_t *reg, int key)
+{
+    registry_table_t *table;
+    unsigned int seq;
+    void *data;
+    int tries, index;
+
+    for(tries = 0; tries < REGISTRY_READ_TRIES; tries++){
+        seq = seqlock_read_begin(&reg->lock);
+
+        table = reg->table;
+        index = registry_table_find(table, key);
+        data = (index < 0) ? NULL : table->entries[index].data;
+
+        /* No writer moved any key during the search */
+        if(!seqlock_read_retry(&reg->lock, seq))
+            return data;
+    }
+
+    /* Too many writers, search with the writer mutex */
+    seqlock_lock(&reg->lock);
+    table = reg->table;
+    index = registry_table_find(table, key);
+    data = (index < 0) ? NULL : table->entries[index].data;
+    seqlock_unlock(&reg->lock);
+
+    return data;
+}
+
+/** @brief Allocate an empty table.
+ *
+ *
+ *  @param size table size, a power of 2
+ *  @return the table, NULL if fail.
+ */
+static registry_table_t *create_registry_table(int size)
+{
+    registry_table_t *table;
+
+    if((table = malloc(sizeof(registry_table_t))) == NULL)
+        return NULL;
+
+    /* key 0 is empty, use calloc here */
+    if((table->entries = calloc(size, sizeof(registry_entry_t))) == NULL){
+        free(table);
+        return NULL;
+    }
+
+    table->size = size;
+    table->count = 0;
+    table->retired = NULL;
+
+    return table;
+}
+
+/** @brief Put a key which is not in the table into an empty entry.
+ *
+ *  The data is set before the key, so a reader which finds the key finds
+ *  the data.
+ *
+ *  @param table the table
+ *  @param key the key
+ *  @param data the data
+ */
+static void registry_table_put(registry_table_t *table, int key, void *data)
+{
+    int index = REGISTRY_HOME(table, key);
+
+    while(table->entries[index].key != 0)
+        index = (index + 1) & (table->size - 1);
+
+    table->entries[index].data = data;
+    table->entries[index].key = key;
+    table->count++;
+}
+
+/** @brief Find the entry of a key.
+ *
+ *
+ *  @param table the table
+ *  @param key the key
+ *  @return the index of the entry, negative if not find.
+ */
+static int registry_table_find(registry_table_t *table, int key)
+{
+    int index = REGISTRY_HOME(table, key);
+    int i, tmp;
+
+    /* The table is never full, but the entries may move under a reader */
+    for(i = 0; i < table->size; i++){
+        tmp = table->entries[index].key;
+        if(tmp == key)
+            return index;
+        if(tmp == 0)
+            return ERROR;
+        index = (index + 1) & (table->size - 1);
+    }
+
+    return ERROR;
+}
+
+/** @brief Replace the table with one twice as large.
+ *
+ *  Called with the writer mutex held. Readers of the old table still find
+ *  every key in it, the old table is not changed any more.
+ *
+ *  @param reg the registry
+ *  @return 0 on success, negative if fail.
+ */
+static int registry_grow(registry_t *reg)
+{
+    registry_table_t *old = reg->table;
+    registry_table_t *table;
+    int i;
+
+    if((table = create_registry_table(old->size * 2)) == NULL)
+        return ERROR;
+
+    for(i = 0; i < old->size; i++){
+        if(old->entries[i].key != 0)
+            registry_table_put(table, old->entries[i].key,
+                               old->entries[i].data);
+    }
+
+    /* Retire the old table, it is never freed */
+    table->retired = old;
+    reg->table = table;
+
+    return OK;
+}
@@ -2,6 +2,18 @@
  *
  *  @brief rwlock functions
  *
+ *  The whole lock is one state word: the reader count, a bit for a writer 
+ *  holding the lock and a bit each for parked writers and parked readers.
+ *  A reader takes the lock with one atomic add if no writer holds it (and,
+ *  preferring writers, none waits); a writer with one compare and exchange
+ *  if the word is 0. Only a thread which has to block takes the queue lock.
+ *
+ *  A thread parks after it sets the waiting bit and checks the state again,
+ *  both with the queue lock held; a thread releasing the lock wakes waiters
+ *  when the state it replaced had the bit set, and takes the queue lock for
+ *  that. So no wakeup is lost. A woken thread tries to take the lock again,
+ *  it may park once more.
+ *
  *  @author Qi Liu   (ID: qiliu)
  *  @author Kaili Li (ID: kailili)
  */
@@ -12,6 +24,28 @@
 #include <mutex.h>
 #include <cond.h>
 #include <rwlock.h>
+#include <thr_internals.h>
+
+/* state word */
+#define RW_WRITER 0x1       /* a writer holds the lock */
+#define RW_WRITER_WAIT 0x2  /* writers are parked */
+#define RW_READER_WAIT 0x4  /* readers are parked */
+#define RW_READER 0x8       /* one reader, the count is above the bits */
+#define RW_WAIT (RW_WRITER_WAIT | RW_READER_WAIT)
+
+#define RW_READERS(state) ((unsigned int)(state) >> 3)
+
+/* read the state word without caching it in a register */
+#define RW_STATE(rwlock) (*(volatile int *)&((rwlock)->state))
+
+static int reader_blocked(rwlock_t *rwlock, int state);
+static void read_lock_slow(rwlock_t *rwlock);
+static void write_lock_slow(rwlock_t *rwlock);
+static void read_unlock(rwlock_t *rwlock);
+static void rwlock_park(rwlock_t *rwlock, int type);
+static void rwlock_wakeup(rwlock_t *rwlock, int writer_first);
+static void set_state_bits(rwlock_t *rwlock, int bits);
+static void clear_state_bits(rwlock_t *rwlock, int bits);
 
 /** @brief init a rwlock
  *  
@@ -25,15 +59,32 @@
  **/
 int rwlock_init(rwlock_t *rwlock)
 {
-      rwlock->rd_cnt= 0;
-      rwlock->wr_cnt= 0;
-      mutex_init(&rwlock->rdcnt_mutex);
-      mutex_init(&rwlock->wrcnt_mutex);
-      cond_init(&rwlock->rd_cond);
-      cond_init(&rwlock->wr_cond);
-      cond_init(&rwlock->writer_cond);
-
-      return OK;
+    return rwlock_init_pref(rwlock, RWLOCK_PREFER_WRITER);
+}
+
+/** @brief init a rwlock with a preference
+ *  
+ * Preferring writers, a reader does not take the lock while a writer waits,
+ * and an unlocking writer wakes a writer first. Preferring readers, a reader
+ * takes the lock whenever no writer holds it, and an unlocking writer wakes
+ * the readers first.
+ * 
+ * @para rwlock:
+ * @para pref: RWLOCK_PREFER_WRITER or RWLOCK_PREFER_READER
+ * @return error or success
+ **/
+int rwlock_init_pref(rwlock_t *rwlock, int pref)
+{
+    if (pref != RWLOCK_PREFER_WRITER && pref != RWLOCK_PREFER_READER)
+        return ERROR;
+
+    rwlock->state = 0;
+    rwlock->pref = pref;
+    rwlock->qlock = 0;
+    linklist_init(&rwlock->rd_queue);
+    linklist_init(&rwlock->wr_queue);
+
+    return OK;
 }
 
 /** @brief destroy a rwlock
@@ -51,14 +102,15 @@ int rwlock_init(rwlock_t *rwlock)
  **/
 void rwlock_destroy(rwlock_t *rwlock)
 {
-    mutex_destroy(&rwlock->rdcnt_mutex);
-    mutex_destroy(&rwlock->wrcnt_mutex);
-    cond_destroy(&rwlock->rd_cond);
-    cond_destroy(&rwlock->wr_cond);
-    cond_destroy(&rwlock->writer_cond);
+    /* 
+     * an unlocking thread may still be waking others up, a waiting bit may
+     * be left over with nobody waiting 
+     */
+    while ((RW_STATE(rwlock) & ~RW_WAIT) || 
+           0 != *(volatile int *)&rwlock->qlock)
+        yield(-1);
 
-    rwlock->rd_cnt= INVALID_CNT;
-    rwlock->wr_cnt= INVALID_CNT;
+    rwlock->state = INVALID_CNT;
 
     return;
 }
@@ -77,43 +129,25 @@ void rwlock_destroy(rwlock_t *rwlock)
 void rwlock_lock(rwlock_t *rwlock, int type)
 {
     switch (type){ 
-	    case RWLOCK_WRITE: {
-    		/* compete with other writers */
-            mutex_lock(&rwlock->wrcnt_mutex);
-            while(rwlock->wr_cnt > 0)
-                cond_wait(&rwlock->wr_cond, &rwlock->wrcnt_mutex);
-
-    		/* I win, and I get the writer lock, exclusively */
-            rwlock->wr_cnt = 1;
-            mutex_unlock(&rwlock->wrcnt_mutex);
-
-    		/* check if there are readers, wait them to finish */
-            mutex_lock(&rwlock->rdcnt_mutex);
-            while(rwlock->rd_cnt > 0)
-                cond_wait(&rwlock->writer_cond, &rwlock->rdcnt_mutex);
-            
-            mutex_unlock(&rwlock->rdcnt_mutex);
+        case RWLOCK_WRITE: {
+            /* free, no waiter either */
+            if (0 == atom_cmpxchg(&rwlock->state, 0, RW_WRITER))
+                return;
 
+            write_lock_slow(rwlock);
             break;
-	    } case RWLOCK_READ: {
-    		/* if there are writers, wait. Writers have priority */
-            mutex_lock(&rwlock->wrcnt_mutex);
-    		
-            while(rwlock->wr_cnt > 0)
-                cond_wait(&rwlock->rd_cond, &rwlock->wrcnt_mutex);
-
-    	    /* else, get the reader lock */
-            mutex_lock(&rwlock->rdcnt_mutex);
-            rwlock->rd_cnt++;
-            mutex_unlock(&rwlock->rdcnt_mutex);
-
-    		/* unlock, after add the reader lock counter */
-            mutex_unlock(&rwlock->wrcnt_mutex);
+        } case RWLOCK_READ: {
+            /* count ourselves in, it stands unless a writer is in the way */
+            if (!reader_blocked(rwlock, 
+                                atom_add(&rwlock->state, RW_READER)))
+                return;
 
+            read_unlock(rwlock);
+            read_lock_slow(rwlock);
             break;
-	    }
-    } 
-	/* other type value */
+        }
+    }
+    /* other type value */
     return;
 }
 
@@ -131,35 +165,21 @@ void rwlock_lock(rwlock_t *rwlock, int type)
  * @para rwlock:
  * @return none
  **/
-void rwlock_unlock(rwlock_t *rwlock) {
-    
-	/* unlock a reader lock */
-    if (&rwlock->rd_cnt > 0) {
-		mutex_lock(&rwlock->rdcnt_mutex);
-        rwlock->rd_cnt--;
-
-		/* no more readers, try to give writer the chance to step in */
-        if (rwlock->rd_cnt == 0) 
-            cond_signal(&rwlock->writer_cond);
-		/* unlock */
-        mutex_unlock(&rwlock->rdcnt_mutex);
-        
-	/* unlock a writer lock */
-    } else {
-    	mutex_lock(&rwlock->rdcnt_mutex);
-        mutex_lock(&rwlock->wrcnt_mutex);
+void rwlock_unlock(rwlock_t *rwlock)
+{
+    int state;
 
-        rwlock->wr_cnt = 0;
+    /* readers do not hold the lock while a writer does */
+    if (!(RW_STATE(rwlock) & RW_WRITER)) {
+        read_unlock(rwlock);
+        return;
+    }
 
-		/* Signal writer that is waiting */
-        cond_signal(&rwlock->wr_cond);
-		
-		/* Broadcast to readers that are waiting */
-        cond_broadcast(&rwlock->rd_cond);
+    state = atom_add(&rwlock->state, -RW_WRITER);
+    if (state & RW_WAIT)
+        rwlock_wakeup(rwlock, rwlock->pref == RWLOCK_PREFER_WRITER);
 
-        mutex_unlock(&rwlock->wrcnt_mutex);
-        mutex_unlock(&rwlock->rdcnt_mutex);      
-    }
+    return;
 }
 
 /** @brief unlock a rwlock
@@ -179,21 +199,201 @@ void rwlock_unlock(rwlock_t *rwlock) {
  **/
 void rwlock_downgrade(rwlock_t *rwlock)
 {
-	mutex_lock(&rwlock->wrcnt_mutex);
-    mutex_lock(&rwlock->rdcnt_mutex);
-
-	/* downgrade */
-	rwlock->wr_cnt --;
-	rwlock->rd_cnt ++;
-	
-	/* Signal writer that is waiting */
-	cond_signal(&rwlock->wr_cond);
-	
-	/* Broadcast to readers that are waiting */
-	cond_broadcast(&rwlock->rd_cond);
-
-	mutex_unlock(&rwlock->rdcnt_mutex);
-    mutex_unlock(&rwlock->wrcnt_mutex);
+    int state;
+
+    /* become a reader in one step, the lock is never free */
+    state = atom_add(&rwlock->state, RW_READER - RW_WRITER);
+
+    /* parked readers may share it, unless writers go first */
+    if ((state & RW_READER_WAIT) && 
+        (rwlock->pref == RWLOCK_PREFER_READER || 
+         !(state & RW_WRITER_WAIT)))
+        rwlock_wakeup(rwlock, 0);
+
+    return;
+}
+
+/** @brief check if a reader can not take the lock
+ *  
+ * @para rwlock:
+ * @para state: the state word
+ * @return 1 if it can not, 0 if it can
+ **/
+static int reader_blocked(rwlock_t *rwlock, int state)
+{
+    if (state & RW_WRITER)
+        return 1;
+
+    return (rwlock->pref == RWLOCK_PREFER_WRITER && 
+            (state & RW_WRITER_WAIT));
+}
+
+/** @brief take the lock for reading, parking while it is blocked
+ *  
+ * @para rwlock:
+ * @return none
+ **/
+static void read_lock_slow(rwlock_t *rwlock)
+{
+    int state;
+
+    while (1) {
+        state = RW_STATE(rwlock);
+        if (reader_blocked(rwlock, state)) {
+            rwlock_park(rwlock, RWLOCK_READ);
+            continue;
+        }
+
+        if (state == atom_cmpxchg(&rwlock->state, state, state + RW_READER))
+            return;
+    }
+}
+
+/** @brief take the lock for writing, parking while it is held
+ *  
+ * The waiting bits are kept when the writer takes the lock.
+ *
+ * @para rwlock:
+ * @return none
+ **/
+static void write_lock_slow(rwlock_t *rwlock)
+{
+    int state;
+
+    while (1) {
+        state = RW_STATE(rwlock);
+        if (state & ~RW_WAIT) {
+            rwlock_park(rwlock, RWLOCK_WRITE);
+            continue;
+        }
+
+        if (state == atom_cmpxchg(&rwlock->state, state, state | RW_WRITER))
+            return;
+    }
+}
+
+/** @brief drop one reader
+ *  
+ * The last reader wakes a parked writer. A reader backing out of the fast 
+ * path also comes here: a writer may have parked because of it.
+ *
+ * @para rwlock:
+ * @return none
+ **/
+static void read_unlock(rwlock_t *rwlock)
+{
+    int state = atom_add(&rwlock->state, -RW_READER);
+
+    if (RW_READERS(state) == 1 && 
+        (state & (RW_WRITER | RW_WRITER_WAIT)) == RW_WRITER_WAIT)
+        rwlock_wakeup(rwlock, 1);
+
+    return;
+}
+
+/** @brief park the calling thread until it is woken up
+ *  
+ * Return at once if the lock is no longer in the way after the waiting bit
+ * is set.
+ *
+ * @para rwlock:
+ * @para type: RWLOCK_READ or RWLOCK_WRITE
+ * @return none
+ **/
+static void rwlock_park(rwlock_t *rwlock, int type)
+{
+    waitnode_t waiter;
+    int blocked;
+
+    waitnode_init(&waiter);
+
+    waitq_lock(&rwlock->qlock);
+    if (type == RWLOCK_READ) {
+        set_state_bits(rwlock, RW_READER_WAIT);
+        blocked = reader_blocked(rwlock, RW_STATE(rwlock));
+        if (blocked)
+            linklist_addtail(&rwlock->rd_queue, &waiter.node);
+    } else {
+        set_state_bits(rwlock, RW_WRITER_WAIT);
+        blocked = RW_STATE(rwlock) & ~RW_WAIT;
+        if (blocked)
+            linklist_addtail(&rwlock->wr_queue, &waiter.node);
+    }
+    waitq_unlock(&rwlock->qlock);
+
+    if (blocked)
+        waitnode_sleep(&waiter);
+
+    return;
+}
+
+/** @brief wake one parked writer, or all parked readers
+ *  
+ * The waiting bit of a queue is cleared when the queue is empty.
+ *
+ * @para rwlock:
+ * @para writer_first: wake a writer if any, otherwise only if no reader
+ * @return none
+ **/
+static void rwlock_wakeup(rwlock_t *rwlock, int writer_first)
+{
+    listnode_t *node, *next;
+
+    waitq_lock(&rwlock->qlock);
+    if (NULL != rwlock->wr_queue.pstfirst && 
+        (writer_first || NULL == rwlock->rd_queue.pstfirst)) {
+        node = linklist_delhead(&rwlock->wr_queue);
+        node->pNext = NULL;
+    } else {
+        node = linklist_delall(&rwlock->rd_queue);
+    }
+
+    if (NULL == rwlock->wr_queue.pstfirst)
+        clear_state_bits(rwlock, RW_WRITER_WAIT);
+    if (NULL == rwlock->rd_queue.pstfirst)
+        clear_state_bits(rwlock, RW_READER_WAIT);
+    waitq_unlock(&rwlock->qlock);
+
+    /* a node is gone once its thread runs, get the next one first */
+    while (NULL != node) {
+        next = node->pNext;
+        waitnode_wakeup((waitnode_t *)node->data);
+        node = next;
+    }
 
     return;
 }
+
+/** @brief set bits of the state word
+ *  
+ * @para rwlock:
+ * @para bits:
+ * @return none
+ **/
+static void set_state_bits(rwlock_t *rwlock, int bits)
+{
+    int state;
+
+    do {
+        state = RW_STATE(rwlock);
+        if ((state & bits) == bits)
+            return;
+    } while (state != atom_cmpxchg(&rwlock->state, state, state | bits));
+}
+
+/** @brief clear bits of the state word
+ *  
+ * @para rwlock:
+ * @para bits:
+ * @return none
+ **/
+static void clear_state_bits(rwlock_t *rwlock, int bits)
+{
+    int state;
+
+    do {
+        state = RW_STATE(rwlock);
+        if (!(state & bits))
+            return;
+    } while (state != atom_cmpxchg(&rwlock->state, state, state & ~bits));
+}
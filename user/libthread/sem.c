@@ -2,14 +2,31 @@
  *
  *  @brief semaphore functions
  *
+ *  The count is changed with one atomic add. A thread which takes more than
+ *  there is owes the difference, the count goes negative; it waits in the
+ *  queue until signals have given it that many units (tokens). A signal 
+ *  that finds the count negative hands tokens to the waiters in FIFO order;
+ *  if a waiter has not queued itself yet, the tokens are kept for it. Only
+ *  these cases take the queue lock.
+ *
  *  @author Qi Liu   (ID: qiliu)
  *  @author Kaili Li (ID: kailili)
  */
 
 #include<def.h>
-#include<sem_type.h>
-#include<cond.h>
+#include<stddef.h>
+#include<sem.h>
 #include<syscall.h>
+#include<thr_internals.h>
+
+/* a thread waiting for units, on its own stack */
+typedef struct {
+    waitnode_t waiter;  /* must be the first member */
+    int needed;         /* units still owed to the thread */
+} sem_waiter_t;
+
+static void sem_block(sem_t *sem, int needed);
+static void sem_give(sem_t *sem, int tokens);
 
 /** @brief init a semaphore
  *  
@@ -24,14 +41,14 @@
  **/
 int sem_init(sem_t *sem, int count)
 {
-    sem->count = count;
-    sem->destr = SEM_DESTR_NO;
-    
-    if (OK != mutex_init(&sem->mutex))
+    if (count < 0)
         return ERROR;
 
-    if (OK != cond_init(&sem->cond))
-        return ERROR;
+    sem->count = count;
+    sem->destr = SEM_DESTR_NO;
+    sem->qlock = 0;
+    sem->tokens = 0;
+    linklist_init(&sem->waitqueue);
     
     return OK;
 }
@@ -53,20 +70,13 @@ void sem_destroy(sem_t *sem)
     /* tell later threads do not use this sem */
     sem->destr = SEM_DESTR_YES;
     
-    while(1) {
-        mutex_lock(&sem->mutex);
-
-        /* wiating until no threads wait for this sem, then destroy it */
-        if (sem->count < 0) {
-            mutex_unlock(&sem->mutex);
-            yield(-1);
-        } else {
-            mutex_unlock(&sem->mutex);
-            mutex_destroy(&sem->mutex);
-            cond_destroy(&sem->cond);
-            break;
-        }
-    }
+    /* 
+     * waiting until no threads wait for this sem, and no signaling thread 
+     * is still handing out tokens 
+     */
+    while (*(volatile int *)&sem->count < 0 || 
+           0 != *(volatile int *)&sem->qlock)
+        yield(-1);
 
     return;
 }
@@ -82,23 +92,58 @@ void sem_destroy(sem_t *sem)
  **/
 void sem_wait(sem_t *sem)
 {
+    sem_wait_n(sem, 1);
+
+    return;
+}
+
+/** @brief wait for n units of a semaphore
+ * 
+ * Take the units there are at once, and wait for the rest.
+ *
+ * @param sem: semaphore
+ * @param n: number of units
+ * @return none
+ **/
+void sem_wait_n(sem_t *sem, int n)
+{
+    int count;
+
     /* this sem has been destroyed, so do not use it */
-    if (sem->destr == SEM_DESTR_YES)
+    if (sem->destr == SEM_DESTR_YES || n <= 0)
         return;
     
-    /* lock the sem */
-    mutex_lock(&sem->mutex);
+    count = atom_add(&sem->count, -n);
+    if (count >= n)
+        return;
 
-    sem->count--;
-    if (sem->count < 0)
-        cond_wait(&sem->cond, &sem->mutex);
-               
-    /* unlock the sem */
-    mutex_unlock(&sem->mutex);
+    /* owe what was not there */
+    sem_block(sem, (count > 0) ? n - count : n);
 
     return;
 }
 
+/** @brief take a unit of a semaphore without blocking
+ * 
+ * @param sem: semaphore
+ * @return 0 if a unit is taken, negative if there is none
+ **/
+int sem_trywait(sem_t *sem)
+{
+    int count;
+
+    if (sem->destr == SEM_DESTR_YES)
+        return ERROR;
+
+    do {
+        count = *(volatile int *)&sem->count;
+        if (count <= 0)
+            return ERROR;
+    } while (count != atom_cmpxchg(&sem->count, count, count - 1));
+
+    return OK;
+}
+
 /** @brief dequeue a thread waiting on semaphore
  * 
  * This function should wake up a thread waiting on the semaphore pointed to
@@ -109,16 +154,114 @@ void sem_wait(sem_t *sem)
  **/
 void sem_signal(sem_t *sem)
 {
-    /* lock the sem */
-    mutex_lock(&sem->mutex);
-    
-    sem->count++;
+    sem_signal_n(sem, 1);
+
+    return;
+}
+
+/** @brief give n units to a semaphore
+ * 
+ * Waiting threads are woken up in one pass if the units are enough for 
+ * them.
+ *
+ * @param sem: semaphore
+ * @param n: number of units
+ * @return none
+ **/
+void sem_signal_n(sem_t *sem, int n)
+{
+    int count;
 
-    /* awake some thread from the waiting queue */
-    cond_signal(&sem->cond);
+    if (n <= 0)
+        return;
+
+    count = atom_add(&sem->count, n);
+
+    /* pay what is owed to the waiters */
+    if (count < 0)
+        sem_give(sem, (-count < n) ? -count : n);
 
-    /* unlock the sem */
-    mutex_unlock(&sem->mutex);
+    return;
+}
+
+/** @brief block until a number of tokens is given to the calling thread
+ * 
+ * @param sem: semaphore
+ * @param needed: number of tokens
+ * @return none
+ **/
+static void sem_block(sem_t *sem, int needed)
+{
+    sem_waiter_t waiter;
+    int tokens;
+
+    waitnode_init(&waiter.waiter);
+
+    waitq_lock(&sem->qlock);
+
+    /* take the tokens signaled before we got here */
+    tokens = (sem->tokens < needed) ? sem->tokens : needed;
+    sem->tokens -= tokens;
+    waiter.needed = needed - tokens;
+    if (0 == waiter.needed) {
+        waitq_unlock(&sem->qlock);
+        return;
+    }
+
+    linklist_addtail(&sem->waitqueue, &waiter.waiter.node);
+    waitq_unlock(&sem->qlock);
+
+    /* the thread giving our last token wakes us up */
+    waitnode_sleep(&waiter.waiter);
+
+    return;
+}
+
+/** @brief hand tokens to the waiting threads in FIFO order
+ * 
+ * Keep the tokens left for waiters which have not queued themselves.
+ *
+ * @param sem: semaphore
+ * @param tokens: number of tokens
+ * @return none
+ **/
+static void sem_give(sem_t *sem, int tokens)
+{
+    sem_waiter_t *waiter;
+    listnode_t *ready = NULL, *last = NULL;
+    listnode_t *node, *next;
+    int n;
+
+    waitq_lock(&sem->qlock);
+    while (tokens > 0 && NULL != sem->waitqueue.pstfirst) {
+        waiter = (sem_waiter_t *)sem->waitqueue.pstfirst->data;
+
+        n = (waiter->needed < tokens) ? waiter->needed : tokens;
+        waiter->needed -= n;
+        tokens -= n;
+
+        /* 
+         * paid in full, wake it up after the queue is unlocked, in the 
+         * order it queued
+         */
+        if (0 == waiter->needed) {
+            node = linklist_delhead(&sem->waitqueue);
+            node->pNext = NULL;
+            if (NULL == last)
+                ready = node;
+            else
+                last->pNext = node;
+            last = node;
+        }
+    }
+    sem->tokens += tokens;
+    waitq_unlock(&sem->qlock);
+
+    /* a node is gone once its thread runs, get the next one first */
+    for (node = ready; NULL != node; node = next) {
+        next = node->pNext;
+        waitnode_wakeup((waitnode_t *)node->data);
+    }
 
     return;
 }
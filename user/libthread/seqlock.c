@@ -0,0 +1,108 @@
+/** @file seqlock.c
+ *  @brief The implementation of the sequence lock.
+ *
+ *  The functions are not inlined, so the compiler does not move reads of
+ *  the data across them; x86 keeps reads in order and writes in order, so
+ *  no fence is needed.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <mutex.h>
+#include <def.h>
+
+#include <seqlock.h>
+
+/** @brief Initialize a sequence lock.
+ *
+ *
+ *  @param sl the sequence lock
+ *  @return 0 on success, negative if fail.
+ */
+int seqlock_init(seqlock_t *sl)
+{
+    sl->seq = 0;
+
+    return mutex_init(&sl->mutex);
+}
+
+/** @brief Destroy a sequence lock.
+ *
+ *
+ *  @param sl the sequence lock
+ */
+void seqlock_destroy(seqlock_t *sl)
+{
+    mutex_destroy(&sl->mutex);
+}
+
+/** @brief Start a change of the data.
+ *
+ *  Readers from now on retry until seqlock_write_end().
+ *
+ *  @param sl the sequence lock
+ */
+void seqlock_write_begin(seqlock_t *sl)
+{
+    mutex_lock(&sl->mutex);
+    sl->seq++;
+}
+
+/** @brief End a change of the data.
+ *
+ *
+ *  @param sl the sequence lock
+ */
+void seqlock_write_end(seqlock_t *sl)
+{
+    sl->seq++;
+    mutex_unlock(&sl->mutex);
+}
+
+/** @brief Take the writer mutex without changing the sequence number.
+ *
+ *  For a writer whose change can not mislead a reader, or a reader which
+ *  has retried too often.
+ *
+ *  @param sl the sequence lock
+ */
+void seqlock_lock(seqlock_t *sl)
+{
+    mutex_lock(&sl->mutex);
+}
+
+/** @brief Release the writer mutex taken by seqlock_lock().
+ *
+ *
+ *  @param sl the sequence lock
+ */
+void seqlock_unlock(seqlock_t *sl)
+{
+    mutex_unlock(&sl->mutex);
+}
+
+/** @brief Start a read of the data.
+ *
+ *  Do not wait for a writer, seqlock_read_retry() fails if one is active.
+ *
+ *  @param sl the sequence lock
+ *  @return the sequence number to pass to seqlock_read_retry()
+ */
+unsigned int seqlock_read_begin(seqlock_t *sl)
+{
+    return sl->seq;
+}
+
+/** @brief Check if a read has to be done again.
+ *
+ *
+ *  @param sl the sequence lock
+ *  @param seq the sequence number from seqlock_read_begin()
+ *  @return nonzero if a writer was active during the read.
+ */
+int seqlock_read_retry(seqlock_t *sl, unsigned int seq)
+{
+    return (seq & 1) || seq != sl->seq;
+}
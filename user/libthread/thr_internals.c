@@ -13,11 +13,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <syscall.h>
 
 #include <thr_internals.h>
-#include <linklist.h>
-#include <hashtable.h>
+#include <registry.h>
+#include <pool.h>
 #include <thread.h>
 #include <autostack.h>
 
@@ -27,12 +29,49 @@
 
 /* -- Macro Definition --*/
 
-/* the default siz of the hash table (the max hash value) */
-#define HASH_TABLE_SIZE 512
+/* the initial size of the thread registry, it grows with the threads */
+#define REGISTRY_SIZE 512
 
 /* make the size page-aligned  */
 #define ALIGN_PAGE_SIZE(size) (((size) + PAGE_SIZE - 1) & 0xfffff000)
 
+/* 
+ * The stack slot table is two-level: a directory of chunks, each chunk holds
+ * SLOT_CHUNK_SIZE slots. Chunks are allocated from a pool when the stack area
+ * grows into them and are never freed, so readers do not need any lock.
+ */
+#define SLOT_CHUNK_SIZE 512
+#define SLOT_DIR_SIZE 1024
+
+/* end of the free slot list */
+#define NO_SLOT -1
+
+/* 
+ * Stack slot information, written only by the thread library. The thread 
+ * structure of the thread on the stack is part of the slot, so creating and 
+ * exiting a thread does not allocate anything.
+ */
+typedef struct{
+    volatile int tid;       /* tid of the thread on the slot */
+    thread_t thread;        /* thread structure of the thread on the slot */
+    int index;              /* index of the slot */
+    int next_free;          /* next slot in the free slot list */
+    volatile int released;  /* the last thread has left the stack */
+} stack_slot_t;
+
+/* get the slot of an embedded thread structure */
+#define THREAD_SLOT(thr) \
+    ((stack_slot_t *)((char *)(thr) - offsetof(stack_slot_t, thread)))
+
+/* 
+ * Free slot list, a lock-free stack. The tag changes on every push and pop, 
+ * so a pop which read a stale top can not succeed (ABA). 
+ */
+typedef struct{
+    volatile int top;   /* first free slot, NO_SLOT if empty */
+    volatile int tag;
+} __attribute__((aligned(8))) slot_stack_t;
+
 /* the thread library information */
 typedef struct{
     int is_init;
@@ -40,18 +79,30 @@ typedef struct{
     int stack_size_max; /* Default stack size */
     int root_tid;  
 
+    thr_stack_policy_t stack_policy;    /* default stack growth policy */
+    int trim_watermark;     /* stack bytes kept when reaped, 0 to keep all */
+    volatile int stack_committed;   /* stack bytes allocated */
+    volatile int stack_trimmed;     /* stack bytes removed */
+
     int thread_nums;    /* Threads number */
     mutex_t thread_nums_mutex;
 
-    /* hash table to contain threads' information */
-    hash_table_t *threads;
-    mutex_t hash_table_mutex;
+    /* registry to contain threads' information, searched without lock */
+    registry_t threads;
 
-    /* linked list to recycle exited thread resource */
-    linklist_t free_stack_list;
+    /* lock-free list to recycle reaped thread resource */
+    slot_stack_t free_slots;
     void *current_base;    
-    mutex_t link_list_mutex;
+    mutex_t stack_mutex;    /* protect current_base */
     
+    /* 
+     * Stack slot table. Slot 0 is the root thread, slot k is the stack whose 
+     * base is stack_top - k * stack_stride.
+     */
+    void *stack_top;    /* current_base after thr_init */
+    int stack_stride;   /* stack_size_max plus the blank page */
+    stack_slot_t *volatile slot_dir[SLOT_DIR_SIZE];
+    pool_t *slot_pool;  /* pool of slot chunks */
 } thread_lib_t;
 
 /* -- Local Variables -- */
@@ -60,14 +111,21 @@ static thread_lib_t thread_lib;
 
 
 /* -- Local Functions -- */
-extern void *get_thread_from_stack();
+extern void vanish_release(volatile int *released);
 
 static void * create_user_stack();
 static thread_t *create_thread_item(void *base);
+static void reset_thread_item(thread_t *thread);
 
 static void put_to_free_list(thread_t *thread);
 static thread_t *find_free_thread();
 
+static void prefault_stack(thread_t *thread);
+static void trim_stack(thread_t *thread);
+
+static stack_slot_t *get_stack_slot(void *addr);
+static stack_slot_t *alloc_stack_slot(void *base);
+
 /** @brief Initialize the thread library.
  *
  *  Do most of the work of thr_init().
@@ -78,6 +136,8 @@ static thread_t *find_free_thread();
 int init_thread_lib(unsigned int size)
 {
     thread_t *tmp;
+    stack_slot_t *slot;
+    int root_size;
         
     /* 
      * Set the max stack size  
@@ -89,54 +149,72 @@ int init_thread_lib(unsigned int size)
     /* Set root tid */
     thread_lib.root_tid = gettid();
 
+    /*
+     * Set current_base according to root thread's stack information. 
+     */
+    root_size = (g_stackinfo.rootstack_hi-g_stackinfo.rootstack_low+1);
+	
+    /*
+     * Root thread may have been allocate with space more than 
+     * default stack size, adjust the current_base.
+     */
+    if(thread_lib.stack_size_max <= (root_size + PAGE_SIZE))
+        thread_lib.current_base = g_stackinfo.rootstack_low + 
+            thread_lib.stack_size_max - 1 - PAGE_SIZE; 
+    else
+        thread_lib.current_base = g_stackinfo.rootstack_hi;
+
+    /* 
+     * Set the stack slot table, the root thread takes slot 0 
+     */
+    thread_lib.stack_top = thread_lib.current_base;
+    thread_lib.stack_stride = thread_lib.stack_size_max + PAGE_SIZE;
+    thread_lib.slot_pool = pool_create(sizeof(stack_slot_t) * SLOT_CHUNK_SIZE);
+    if(thread_lib.slot_pool == NULL)
+        return ERROR;
+    if((slot = alloc_stack_slot(thread_lib.stack_top)) == NULL)
+        return ERROR;
+
     /* 
      * Set stack number 
      * 1. create root threads 
      */
     tmp = create_thread_item(g_stackinfo.rootstack_hi);
-    if(tmp == NULL)
-        return ERROR;
-
+    tmp->stack_size = root_size;
     tmp->tid = thread_lib.root_tid;
 	tmp->status = RUNNING;
+    tmp->started = THREAD_START_GO;
+
+    /* The root thread keeps the policy and growth it has had so far */
+    tmp->stack_policy = thread_lib.stack_policy;
+    tmp->last_grow = g_stackinfo.root_last_grow;
+    tmp->stack_faults = g_stackinfo.root_faults;
     
     thread_lib.thread_nums = 1;
     mutex_init(&thread_lib.thread_nums_mutex);
      
     /* 
-     * Set hash table
+     * Set registry
      * 1. contain root thread structure */
-    thread_lib.threads = create_hash_table(HASH_TABLE_SIZE);
-    if(thread_lib.threads == NULL)
+    if(registry_init(&thread_lib.threads, REGISTRY_SIZE) < 0)
         return ERROR;
     
-    hash_table_insert(thread_lib.threads, thread_lib.root_tid, (void *)tmp);
-    mutex_init(&thread_lib.hash_table_mutex);
+    if(registry_insert(&thread_lib.threads, thread_lib.root_tid, tmp) < 0)
+        return ERROR;
 
-    /*
-     * Set current_base according to root thread's stack information. 
-     */
-    tmp->stack_size = (g_stackinfo.rootstack_hi-g_stackinfo.rootstack_low+1);
-	
-    /*
-     * Root thread may have been allocate with space more than 
-     * default stack size, adjust the current_base.
-     */
-    if(thread_lib.stack_size_max <= (tmp->stack_size + PAGE_SIZE))
-        thread_lib.current_base = g_stackinfo.rootstack_low + 
-            thread_lib.stack_size_max - 1 - PAGE_SIZE; 
-    else
-        thread_lib.current_base = g_stackinfo.rootstack_hi;
+    slot->tid = thread_lib.root_tid;
 
     /* 
-     * Set the free stack list 
+     * Set the free slot list 
      */
-    linklist_init(&thread_lib.free_stack_list);
-    mutex_init(&thread_lib.link_list_mutex);
+    thread_lib.free_slots.top = NO_SLOT;
+    thread_lib.free_slots.tag = 0;
+    mutex_init(&thread_lib.stack_mutex);
 
     /*
      * Set library as inited.
      */
+    g_stackinfo.root_thread = tmp;
     g_stackinfo.is_init = LIB_IS_INIT;
     thread_lib.is_init = LIB_IS_INIT;
 
@@ -148,13 +226,16 @@ int init_thread_lib(unsigned int size)
  *    First, try to find a thread structure from the free list which contains recycled
  *  thread resource.
  *  
- *  If the free list is empty, allocate new thread structure and stack resource.
+ *  If the free list is empty, allocate new stack resource. The thread structure
+ *  is part of the stack slot.
  *
  *  @param func the function to be run by the child thread.
  *  @param arg the arg fo the func.
+ *  @param policy stack growth policy, NULL for the default one.
  *  @return thread structure
  */
-thread_t  *prepare_thread(void *(*func)(void *), void * arg)
+thread_t  *prepare_thread(void *(*func)(void *), void * arg,
+                          const thr_stack_policy_t *policy)
 {
     void *new_stack;
     thread_t *new_thread;
@@ -164,21 +245,25 @@ thread_t  *prepare_thread(void *(*func)(void *), void * arg)
 
     /* Not find a thread structure, allocate new one */
     if(new_thread == NULL){
-        /* Create a thread structure */
+        /* Create a stack */
         new_stack = create_user_stack();
         if(new_stack == NULL)
             return NULL;
 
         /* Create a thread structure  */
         new_thread = create_thread_item(new_stack);
-        /* cannot rollback here */
-        if(new_thread == NULL)
-            return NULL;
     }
 
     /* Set the func and arg to the thread structure */
     new_thread->func = func; 
     new_thread->arg = arg;
+
+    /* Set the stack growth policy */
+    new_thread->stack_policy = (policy != NULL) ? *policy : 
+        thread_lib.stack_policy;
+    new_thread->last_grow = 0;
+    new_thread->stack_faults = 0;
+    prefault_stack(new_thread);
     
     return new_thread;
 }
@@ -191,10 +276,56 @@ thread_t  *prepare_thread(void *(*func)(void *), void * arg)
  */
 void prepare_thread_rollback(thread_t *thread)
 {    
+    /* No thread has run on the stack */
+    THREAD_SLOT(thread)->released = 1;
+
     /* put the thread into free list */
     put_to_free_list(thread);
 }
 
+/** @brief Check a stack growth policy.
+ *
+ *  @param policy the policy
+ *  @return 0 if the policy is valid, negative if not.
+ */
+int check_stack_policy(const thr_stack_policy_t *policy)
+{
+    if(policy == NULL || 
+       (policy->policy != THR_STACK_GROW_FIXED && 
+        policy->policy != THR_STACK_GROW_DOUBLE) ||
+       policy->chunk_pages < 0 || policy->max_chunk_pages < 0 || 
+       policy->prefault_pages < 0)
+        return ERROR;
+
+    return OK;
+}
+
+/** @brief Set the default stack growth policy.
+ *
+ *  Used by the root thread until thr_init() and by threads created later.
+ *
+ *  @param policy the policy
+ *  @return 0 on success, negative if the policy is invalid.
+ */
+int set_stack_policy(const thr_stack_policy_t *policy)
+{
+    if(check_stack_policy(policy) < 0)
+        return ERROR;
+
+    thread_lib.stack_policy = *policy;
+
+    return OK;
+}
+
+/** @brief Get the default stack growth policy.
+ *
+ *  @return the policy
+ */
+thr_stack_policy_t *get_stack_policy(void)
+{
+    return &thread_lib.stack_policy;
+}
+
 /** @brief Run the thread with func(arg).
  *
  *  Wait until the parent make the thread RUNNING, the run func(arg).
@@ -205,18 +336,25 @@ void do_thread()
 {
     thread_t *tmp;
     void *status;
+    int reject = 0;
 
     /*
-     * Get the thread struture from the stack. 
+     * Get the thread struture from the slot of the stack we run on. 
      */
-    tmp = (thread_t *)get_thread_from_stack();
+    tmp = &get_stack_slot(&tmp)->thread;
 
     /* Register exception handler */
-    register_exception_handler(tmp->stack_base + 1, NULL);
+    register_exception_handler(tmp->stack_base + 1, tmp, NULL);
 
-    /* Wait for parent thread make me runnable */
-    while(tmp->status != RUNNING)
-        yield(-1);
+    /* 
+     * Wait for parent thread make me runnable. Once we are parked, only the
+     * parent wakes us, and it only calls make_runnable() for a parked child,
+     * so no wakeup is left over to end a later wait of ours. If the parent
+     * was first, we start at once.
+     */
+    if(atom_cmpxchg(&tmp->started, THREAD_START_WAIT, 
+                    THREAD_START_PARKED) == THREAD_START_WAIT)
+        deschedule(&reject);
 
     /*
      * Start thread here 
@@ -228,6 +366,10 @@ void do_thread()
 }
 
 /** @brief Get thread by its tid.
+ *
+ *  The registry is searched without lock. Thread structures live in the 
+ *  stack slot table and are never freed, so a thread being reaped at the
+ *  same time is still safe to read.
  *
  *  @param tid the target thread's tid.
  *  @return the targe thread, NULL if not existed.
@@ -237,17 +379,101 @@ thread_t *get_thread_by_tid(int tid)
 {
     thread_t *tmp;
     
-    /* Search in the hash table */
-    mutex_lock(&thread_lib.hash_table_mutex);
-    tmp = hash_table_search(thread_lib.threads, tid);
-    mutex_unlock(&thread_lib.hash_table_mutex);
+    /* Search in the registry */
+    tmp = registry_lookup(&thread_lib.threads, tid);
 
     return tmp;
 }
 
+/** @brief Get the thread structure of the current thread without gettid().
+ *
+ *    The current %esp tells which stack slot the thread runs on. The result is
+ *  only trusted if the slot has been registered by the library with the same 
+ *  tid as the thread structure, and %esp is inside the thread's stack rather 
+ *  than the blank page. Nothing is read from the stack itself. A fiber stack
+ *  gives the thread running the fiber.
+ *
+ *  @return the current thread, NULL if it cannot be verified.
+ */
+thread_t *get_self_thread(void)
+{
+    stack_slot_t *slot;
+    thread_t *thread;
+    fiber_t *fiber;
+    char *esp = (char *)&slot;  /* an address on the current stack */
+    char *low;
+    int tid;
+
+    if(thread_lib.is_init != LIB_IS_INIT)
+        return NULL;
+
+    /* On a fiber stack, it is the thread running the fiber */
+    if((fiber = fiber_self()) != NULL)
+        return fiber->sched->thread;
+
+    slot = get_stack_slot(esp);
+    if(slot == NULL)
+        return NULL;
+
+    /* The slot is not registered, or is being recycled */
+    tid = slot->tid;
+    if(tid == INVALID_THREAD)
+        return NULL;
+    thread = &slot->thread;
+    if(thread->tid != tid)
+        return NULL;
+
+    /* Check %esp against the stack range of the thread */
+    if(slot == &thread_lib.slot_dir[0][0])
+        low = (char *)thread_lib.stack_top - thread_lib.stack_stride;
+    else
+        low = (char *)thread->stack_base - thread_lib.stack_size_max;
+    if(esp <= low || esp > (char *)thread->stack_base)
+        return NULL;
+
+    return thread;
+}
+
+/** @brief Get the index of the stack slot of a thread.
+ *
+ *  @param thread the thread
+ *  @return the index
+ */
+int get_thread_index(thread_t *thread)
+{
+    return THREAD_SLOT(thread)->index;
+}
+
+/** @brief Get the thread structure in a stack slot.
+ *
+ *  @param index index of the slot, returned by get_thread_index()
+ *  @return the thread structure
+ */
+thread_t *get_thread_by_index(int index)
+{
+    return &thread_lib.slot_dir[index / SLOT_CHUNK_SIZE]
+                               [index % SLOT_CHUNK_SIZE].thread;
+}
+
+/** @brief Get the tid of the current thread.
+ *
+ *  Use the stack slot lookup, fall back to gettid() if it cannot be verified.
+ *
+ *  @return the tid of the current thread.
+ */
+int get_self_tid(void)
+{
+    thread_t *thread;
+
+    if((thread = get_self_thread()) != NULL)
+        return thread->tid;
+
+    return gettid();
+}
+
 /** @brief Make a thread running.
  *
- *  Put the thread structure into the hash table, and add thread_nums by 1.
+ *  Put the thread structure into the registry, and add thread_nums by 1.
  *
  *  @param tid the target thread's tid.
  *  @return new_thread the targe thread. 
@@ -256,36 +482,35 @@ thread_t *get_thread_by_tid(int tid)
 void make_thread_running(int tid, thread_t *new_thread)
 {
     /* 
-     * Put in the hash table 
-     */
-    mutex_lock(&thread_lib.hash_table_mutex);
-    /* 
+     * Put in the registry
      * Note: Tid will be different for different threads, no need to check 
      * the return value. The caller of the function make sure there is no 
      * same tid. 
      */
-    hash_table_insert(thread_lib.threads, tid, (void *)new_thread);
-    mutex_unlock(&thread_lib.hash_table_mutex);
+    registry_insert(&thread_lib.threads, tid, new_thread);
 
     /* Increase the thread number */
     mutex_lock(&thread_lib.thread_nums_mutex);
     thread_lib.thread_nums ++;
     mutex_unlock(&thread_lib.thread_nums_mutex);
+
+    /* Register the thread on its stack slot */
+    THREAD_SLOT(new_thread)->tid = tid;
 }
 
 /** @brief Reap the thread structure.
  *
- *    Called by thr_join().
+ *    Called by thr_join(). The stack slot with the thread structure goes to
+ *  the free list once the exited thread has left the stack, so the stack can
+ *  be trimmed.
  *
  *  @return thread the targe thread.
  *  @param tid the target thread's tid. 
  */
 void reap_thread(thread_t *thread, int tid)
 {    
-    /* Delete from hash table */
-    mutex_lock(&thread_lib.hash_table_mutex);
-    hash_table_delete(thread_lib.threads, tid);
-    mutex_unlock(&thread_lib.hash_table_mutex);
+    /* Delete from the registry */
+    registry_remove(&thread_lib.threads, tid);
 
     /* 
      * Delete the thread 
@@ -293,19 +518,27 @@ void reap_thread(thread_t *thread, int tid)
     mutex_destroy(&thread->thr_mutex);
     cond_destroy(&thread->exit_cond);
 
-    free(thread);
+    /* The exited thread may not have left the stack yet */
+    while(!THREAD_SLOT(thread)->released)
+        yield(tid);
+
+    trim_stack(thread);
+
+    /* Put the resource(thread struture, stack) into free list */    
+    put_to_free_list(thread);
 }
 
 /** @brief Exit the thread and recycle the resource.
  *
- *  Called by thr_exit().
+ *  Called by thr_exit(). The stack is recycled when the thread is reaped by 
+ *  thr_join(), but a new thread can only run on it after we have left it.
  *
- *  @param ch the character to print
+ *  @param thread the current thread
  *  @return 
  */
 void exit_thread(thread_t *thread)
 {
-    thread_t *new_thread;
+    stack_slot_t *slot = THREAD_SLOT(thread);
 
     /* Decrease the thread number and check if it is the last thread */
     mutex_lock(&thread_lib.thread_nums_mutex);
@@ -314,23 +547,24 @@ void exit_thread(thread_t *thread)
         set_status((int)thread->exit_status);
     mutex_unlock(&thread_lib.thread_nums_mutex);
     
+    /* Destroy the bound arenas before the malloc cache is given back */
+    arena_thread_exit(thread);
+
+    /* Give back the blocks and objects cached for the thread */
+    malloc_thread_exit(thread);
+    pool_thread_exit(thread);
+
     /* 
-     * Make a copy of the exited thread to keep records of 
-     * its stack information. 
+     * The stack slot will be reused, unregister it. Do it before signaling,
+     * the joining thread may recycle the slot right after that.
      */
-    new_thread = create_thread_item(thread->stack_base);
-
-    new_thread->stack_size = thread->stack_size;
-    new_thread->tid = INVALID_THREAD;
+    slot->tid = INVALID_THREAD;
 
     /* Try to signal the joining thread, at most one joining thread */
     cond_signal(&thread->exit_cond);
 
-    /* Put the resource(thread struture, stack) into free list */    
-    put_to_free_list(new_thread);
-
-    /* Exit thread */
-    vanish();
+    /* Exit thread, the stack can be reused from now on */
+    vanish_release(&slot->released);
 }
 
 
@@ -343,13 +577,20 @@ static void * create_user_stack()
 {
     void *page_addr;
     
-    mutex_lock(&thread_lib.link_list_mutex);
+    mutex_lock(&thread_lib.stack_mutex);
     
     /* 
      * One more page to seperate the threads, the bland page will not be used 
      * by any thread. It seperate threads' stack space.
      */
     thread_lib.current_base -= (thread_lib.stack_size_max + PAGE_SIZE);
+
+    /* Make sure the stack slot can be registered */
+    if(alloc_stack_slot(thread_lib.current_base) == NULL){
+        thread_lib.current_base += (thread_lib.stack_size_max + PAGE_SIZE);
+        mutex_unlock(&thread_lib.stack_mutex);
+        return NULL;
+    }
     
     page_addr = thread_lib.current_base - PAGE_SIZE*2 + 1;
     if (new_pages(page_addr, PAGE_SIZE * 2) < 0){
@@ -357,16 +598,121 @@ static void * create_user_stack()
          * The 'only' reason that new_page() fault is that is allocated, so it
          * is better NOT to recover current_base's value.
          */
-        mutex_unlock(&thread_lib.link_list_mutex);
+        mutex_unlock(&thread_lib.stack_mutex);
         return NULL;
     }
+    atom_add((int *)&thread_lib.stack_committed, PAGE_SIZE * 2);
     
-    mutex_unlock(&thread_lib.link_list_mutex);
-    return thread_lib.current_base;
+    page_addr = thread_lib.current_base;
+    mutex_unlock(&thread_lib.stack_mutex);
+    return page_addr;
 }
 
 
-/** @brief Malloc a thread structure and initialize with default value.
+/** @brief Allocate the stack pages asked by the policy before the thread runs.
+ *
+ *  A recycled stack may have them already. It is only a hint, the stack can
+ *  still grow on faults if new_pages() fails.
+ *
+ *  @param thread the new thread
+ */
+static void prefault_stack(thread_t *thread)
+{
+    int size;
+
+    /* One more page for exception stack */
+    size = (thread->stack_policy.prefault_pages + 1) * PAGE_SIZE;
+    if(size > thread_lib.stack_size_max)
+        size = thread_lib.stack_size_max;
+    if(size <= thread->stack_size)
+        return;
+
+    /* Leave the last region record to the growth on faults */
+    if(thread->stack_nregions >= STACK_REGION_MAX - 1)
+        return;
+
+    if(new_pages((char *)thread->stack_base - size + 1, 
+                 size - thread->stack_size) < 0)
+        return;
+
+    record_stack_region(thread, size - thread->stack_size);
+    thread->stack_size = size;
+}
+
+/** @brief Remove the stack regions of a reaped thread below the watermark.
+ *
+ *  A region is removed as a whole (remove_pages() takes the base given to
+ *  new_pages()), the lowest one first. The first two pages are never 
+ *  removed. 
+ *
+ *  @param thread the reaped thread, which has left its stack
+ */
+static void trim_stack(thread_t *thread)
+{
+    int size;
+
+    if(thread_lib.trim_watermark == 0)
+        return;
+
+    while(thread->stack_nregions > 0){
+        size = thread->stack_regions[thread->stack_nregions - 1];
+        if(thread->stack_size - size < thread_lib.trim_watermark)
+            break;
+
+        if(remove_pages((char *)thread->stack_base - thread->stack_size + 1)
+           < 0)
+            break;
+
+        thread->stack_size -= size;
+        thread->stack_nregions--;
+        atom_add((int *)&thread_lib.stack_committed, -size);
+        atom_add((int *)&thread_lib.stack_trimmed, size);
+    }
+}
+
+/** @brief Record a stack region allocated below the stack.
+ *
+ *  Called by the thread itself in the autostack handler, or before the 
+ *  thread runs. Take no lock.
+ *
+ *  @param thread the thread
+ *  @param size size of the region
+ */
+void record_stack_region(thread_t *thread, int size)
+{
+    if(thread->stack_nregions < STACK_REGION_MAX)
+        thread->stack_regions[thread->stack_nregions++] = size;
+
+    atom_add((int *)&thread_lib.stack_committed, size);
+}
+
+/** @brief Set the trim watermark of recycled stacks.
+ *
+ *  @param watermark_pages stack pages kept, negative to keep all
+ *  @return 0 on success
+ */
+int set_stack_trim(int watermark_pages)
+{
+    /* One more page for exception stack */
+    if(watermark_pages < 0)
+        thread_lib.trim_watermark = 0;
+    else
+        thread_lib.trim_watermark = (watermark_pages + 1) * PAGE_SIZE;
+
+    return OK;
+}
+
+/** @brief Get the stack memory counters.
+ *
+ *  @param stats where to put the counters
+ */
+void get_stack_stats(thr_stack_stats_t *stats)
+{
+    stats->committed_bytes = thread_lib.stack_committed;
+    stats->trimmed_bytes = thread_lib.stack_trimmed;
+}
+
+/** @brief Initialize the thread structure in the slot of a new stack.
  *
  *
  *  @param base the top stack address.
@@ -374,10 +720,7 @@ static void * create_user_stack()
  */     
 static thread_t *create_thread_item(void *base)
 {
-    thread_t *tmp;
-
-    if((tmp = malloc(sizeof(thread_t))) == NULL)
-        return NULL;
+    thread_t *tmp = &get_stack_slot(base)->thread;
 
     /* 
      * Set values 
@@ -386,62 +729,154 @@ static thread_t *create_thread_item(void *base)
     tmp->stack_base = base;
     /* One page for exception stack and one for user stack */
     tmp->stack_size = PAGE_SIZE * 2; 
-    tmp->join_thread = INVALID_THREAD;
-    tmp->exit_status = NULL;
-    tmp->status = EXITED;
+    tmp->stack_nregions = 0;
 
-    /* Initailize mutex and conditional variable */
-    mutex_init(&tmp->thr_mutex);
-    cond_init(&tmp->exit_cond);
+    reset_thread_item(tmp);
     
     return tmp;
 }
 
+/** @brief Initialize a thread structure with default value.
+ *
+ *  The stack information is kept, the stack is recycled with the structure.
+ *
+ *  @param thread the thread structure
+ */     
+static void reset_thread_item(thread_t *thread)
+{
+    thread->tid = INVALID_THREAD;
+    thread->join_thread = INVALID_THREAD;
+    thread->exit_status = NULL;
+    thread->status = EXITED;
+    thread->started = THREAD_START_WAIT;
+    thread->arenas = NULL;
+    thread->tpool_worker = NULL;
+    thread->fiber_sched = NULL;
+#ifdef MALLOC_STATS
+    memset(&thread->malloc_stats, 0, sizeof(malloc_stats_t));
+#endif
+
+    /* Initailize mutex and conditional variable */
+    mutex_init(&thread->thr_mutex);
+    cond_init(&thread->exit_cond);
+}
+
 /** @brief Put a thread structure into the free list.
  *
+ *  Push its slot onto the lock-free free slot list.
  *
  *  @param thread the target thread
  */
-
-/* put an structure to the free list */
 static void put_to_free_list(thread_t *thread)
 {
-    listnode_t *node;
-
-    /* Put into the free list */
-    node = malloc(sizeof(listnode_t));
-    node->data = (void *)thread;
-    node->pNext = NULL;
-
-    mutex_lock(&thread_lib.link_list_mutex);
-    linklist_addtail(&thread_lib.free_stack_list, node);
-    mutex_unlock(&thread_lib.link_list_mutex);
+    stack_slot_t *slot = THREAD_SLOT(thread);
+    int top, tag;
+
+    do{
+        top = thread_lib.free_slots.top;
+        tag = thread_lib.free_slots.tag;
+        slot->next_free = top;
+    }while(!atom_cmpxchg64(&thread_lib.free_slots, top, tag, 
+                           slot->index, tag + 1));
 }
 
 /** @brief Find a thread structure from the free list.
  *
+ *  Pop a slot from the lock-free free slot list. Slots are never freed, so
+ *  reading next_free of a slot which has just been taken by another thread
+ *  is safe, the tag makes the exchange fail then.
  *
  *  @return a thread stucture
  */
 static thread_t *find_free_thread()
 {
-    listnode_t *node;
-    thread_t *thread;
+    stack_slot_t *slot;
+    int top, tag, next;
 
-    /* Find from the free list */
-    mutex_lock(&thread_lib.link_list_mutex);
-    node = linklist_delhead(&thread_lib.free_stack_list);
-    mutex_unlock(&thread_lib.link_list_mutex); 
+    do{
+        top = thread_lib.free_slots.top;
+        tag = thread_lib.free_slots.tag;
 
-    /* Not find an structure, return NULL */
-    if(node == NULL)
-        return NULL;
+        /* Not find an structure, return NULL */
+        if(top == NO_SLOT)
+            return NULL;
+
+        slot = &thread_lib.slot_dir[top / SLOT_CHUNK_SIZE][top % SLOT_CHUNK_SIZE];
+        next = slot->next_free;
+    }while(!atom_cmpxchg64(&thread_lib.free_slots, top, tag, next, tag + 1));
 
-    /* Get the thread struture and free the node */
-    thread = (thread_t *)node->data;
-    free(node);
+    /* Only stacks which have been left are on the list, see reap_thread() */
+    slot->released = 0;
+
+    reset_thread_item(&slot->thread);
     
-    return thread;
+    return &slot->thread;
 }
 
+/** @brief Get the stack slot which an address belongs to.
+ *
+ *
+ *  @param addr an address on a thread stack
+ *  @return the stack slot, NULL if the slot does not exist.
+ */
+static stack_slot_t *get_stack_slot(void *addr)
+{
+    unsigned int index;
+    stack_slot_t *chunk;
+
+    /* The root thread's stack may be above the first stack slot */
+    if((char *)addr > (char *)thread_lib.stack_top)
+        index = 0;
+    else
+        index = ((char *)thread_lib.stack_top - (char *)addr) / 
+            thread_lib.stack_stride;
+
+    if(index >= SLOT_CHUNK_SIZE * SLOT_DIR_SIZE)
+        return NULL;
+
+    chunk = thread_lib.slot_dir[index / SLOT_CHUNK_SIZE];
+    if(chunk == NULL)
+        return NULL;
+
+    return &chunk[index % SLOT_CHUNK_SIZE];
+}
 
+/** @brief Make sure the stack slot of a new stack exists.
+ *
+ *  Called with stack_mutex held (or in thr_init).
+ *
+ *  @param base the top stack address.
+ *  @return the stack slot, NULL if fail.
+ */
+static stack_slot_t *alloc_stack_slot(void *base)
+{
+    unsigned int index;
+    stack_slot_t *chunk;
+    int i;
+
+    index = ((char *)thread_lib.stack_top - (char *)base) / 
+        thread_lib.stack_stride;
+    if(index >= SLOT_CHUNK_SIZE * SLOT_DIR_SIZE)
+        return NULL;
+
+    /* The chunk has not been allocated */
+    if(thread_lib.slot_dir[index / SLOT_CHUNK_SIZE] == NULL){
+        if((chunk = pool_alloc(thread_lib.slot_pool)) == NULL)
+            return NULL;
+
+        for(i = 0; i < SLOT_CHUNK_SIZE; i++){
+            chunk[i].tid = INVALID_THREAD;
+            chunk[i].thread.tid = INVALID_THREAD;
+            memset(&chunk[i].thread.malloc_cache, 0, sizeof(malloc_cache_t));
+            memset(&chunk[i].thread.pool_cache, 0, sizeof(pool_cache_t));
+            chunk[i].index = (index / SLOT_CHUNK_SIZE) * SLOT_CHUNK_SIZE + i;
+            chunk[i].next_free = NO_SLOT;
+            chunk[i].released = 0;
+        }
+
+        /* Publish the chunk after it is initialized */
+        thread_lib.slot_dir[index / SLOT_CHUNK_SIZE] = chunk;
+    }
+
+    return &thread_lib.slot_dir[index / SLOT_CHUNK_SIZE][index % SLOT_CHUNK_SIZE];
+}
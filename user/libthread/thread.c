@@ -23,7 +23,8 @@
  *  3. Resource recycle
  *     When a thread exit, we will not release its stack immediately. We will
  *     put it into a free list. When new thread is created, we will find from 
- *     the free list first. 
+ *     the free list first. The thread structure is part of the stack slot, 
+ *     so no malloc() or free() is needed to create or exit a thread.
  *
  *  4. How to get tid
  *     It is true that there are some quick way to get current thread's tid. 
@@ -37,11 +38,18 @@
  *
  *     We want thr_gettid() always return with a right value.
  *
- *  5. Hash table
- *     We use a hash table to contain the threads information. As the thread 
- *     tid generated by the kernal will increase and not repeat. There will be
- *     less collision in the table. As a result, we expect to find one thread
- *     item with constant time.
+ *     Instead, the stacks are laid out at a fixed stride, so %esp tells which
+ *     stack slot the thread runs on. The library records the tid of each slot
+ *     in its own table (not on the stack). The lookup is only used when the
+ *     slot's tid matches the thread structure and %esp is inside that stack,
+ *     otherwise we still call gettid().
+ *
+ *  5. Thread registry
+ *     We use a registry (an open addressing hash table) to contain the 
+ *     threads information. As the thread tid generated by the kernal will 
+ *     increase and not repeat. There will be less collision in the table. As
+ *     a result, we expect to find one thread item with constant time. Lookups
+ *     do not take any lock.
  *  
  *  @author Kaili Li (kailili)
  *  @author Qi Liu (qiliu)
@@ -55,7 +63,9 @@
 #include <syscall.h>
 
 #include <thread.h>
+#include <thrstack.h>
 #include <thr_internals.h>
+#include <autostack.h>
 
 #include <def.h>
 
@@ -93,14 +103,31 @@ int thr_init( unsigned int size )
  *  @return returns zero on success, and a negative number on error.
  */
 int thr_create(void *(*func)(void *), void * arg)
+{
+    return thr_create_policy(func, arg, NULL);
+}
+
+/** @brief Creates a new thread to run func(arg) with a stack growth policy.
+ *
+ *  @param func the function to be run by the child thread.
+ *  @param arg the arg fo the func.
+ *  @param policy stack growth policy of the thread, NULL for the default one.
+ *  @return returns zero on success, and a negative number on error.
+ */
+int thr_create_policy(void *(*func)(void *), void *arg,
+                      const thr_stack_policy_t *policy)
 {
     thread_t *new_thread;
     int ret;
 
+    /* Check the policy */
+    if(policy != NULL && check_stack_policy(policy) < 0)
+        return ERROR;
+
     /*
      * Allocate a stack and a thread item.
      */
-    new_thread = prepare_thread(func, arg);
+    new_thread = prepare_thread(func, arg, policy);
     if(new_thread == NULL)
         return ERROR;
 
@@ -125,6 +152,16 @@ int thr_create(void *(*func)(void *), void * arg)
         new_thread->status = RUNNING;
         mutex_unlock(&new_thread->thr_mutex);
 
+        /* 
+         * Let the child start. A parked child is descheduled, or about to
+         * be, so retry until it is. Otherwise it sees GO and does not block.
+         */
+        if(atom_xchg(&new_thread->started, THREAD_START_GO) == 
+           THREAD_START_PARKED){
+            while(make_runnable(ret) < 0)
+                yield(ret);
+        }
+
         /* Return child thread tid */
         return ret;
     }
@@ -152,13 +189,12 @@ int thr_join( int tid, void **statusp )
     int self_tid;
 
     /* Join on the self, return error */
-    self_tid = gettid();
+    self_tid = get_self_tid();
     if(self_tid == tid)
         return ERROR;
 
     /* The thread is not created yet */
     thread = get_thread_by_tid(tid);
-	lprintf("root addr %p\n", thread->stack_base);
     if(thread == NULL)   
         return ERROR;
     
@@ -185,7 +221,7 @@ int thr_join( int tid, void **statusp )
     if(statusp != NULL)
         *statusp = thread->exit_status;
     mutex_unlock(&thread->thr_mutex);
-	lprintf("get join %p %d\n", thread->stack_base, (int)*statusp);
+
     /* Reap the thread item */
     reap_thread(thread, tid);
 
@@ -206,11 +242,11 @@ void thr_exit( void *status )
     thread_t *thread;
     int tid;
 
-    /* Get the thread infomation */
-    tid = gettid();
-	lprintf("before get tid %d\n", tid);
-    thread = get_thread_by_tid(tid);
-	lprintf("get exit %d %p\n", tid, thread);
+    /* Get the thread infomation, look up by tid if the stack slot fails */
+    if((thread = get_self_thread()) == NULL){
+        tid = gettid();
+        thread = get_thread_by_tid(tid);
+    }
 	
     /* Set status and exit status */
     mutex_lock(&thread->thr_mutex);
@@ -218,23 +254,21 @@ void thr_exit( void *status )
     thread->exit_status = status;
     mutex_unlock(&thread->thr_mutex);
 
-	lprintf("exit %d %p %d\n", gettid(), thread->stack_base, (int)thread->exit_status);
-
     /* Clean up the thread resource and exit the thread */
     exit_thread(thread);
 }
 
 /** @brief Returns the thread ID of the currently running thread.
  *
- *  I use the gettid() system call to implement the function. It is true that 
- *  the method is slow, but it is the only way to make sure the function always 
- *  return the right value. See README.dox for some detail reason.
+ *  The tid is found from the stack slot table written by the library, which
+ *  does not trap into the kernel. If the lookup cannot be verified we use the 
+ *  gettid() system call. See README.dox for some detail reason.
  *
  *  @return the thread ID of the currently running thread
  */
 int thr_getid( void )
 {
-    return gettid();
+    return get_self_tid();
 }
 
 /** @brief Defers execution of the invoking thread to a later time in favor of
@@ -273,3 +307,54 @@ int thr_yield( int tid )
         return OK;
 }
 
+
+/** @brief Set the default stack growth policy.
+ *
+ *  The root thread uses it until thr_init() is called, threads created by
+ *  thr_create() use the one set at their creation.
+ *
+ *  @param policy the policy.
+ *  @return returns zero on success, and a negative number on error.
+ */
+int thr_setstackpolicy(const thr_stack_policy_t *policy)
+{
+    return set_stack_policy(policy);
+}
+
+/** @brief Get the number of stack growth faults of the calling thread.
+ *
+ *  @return the number of faults.
+ */
+int thr_getstackfaults(void)
+{
+    thread_t *thread = get_self_thread();
+
+    /* Root thread before thr_init() */
+    if(thread == NULL)
+        return g_stackinfo.root_faults;
+
+    return thread->stack_faults;
+}
+
+/** @brief Set the trim watermark of recycled stacks.
+ *
+ *  When a thread is reaped, its stack is trimmed down to watermark_pages 
+ *  pages before the stack is reused.
+ *
+ *  @param watermark_pages stack pages kept, negative to keep all pages.
+ *  @return returns zero on success, and a negative number on error.
+ */
+int thr_setstacktrim(int watermark_pages)
+{
+    return set_stack_trim(watermark_pages);
+}
+
+/** @brief Get the stack memory counters of the thread library.
+ *
+ *  @param stats where to put the counters.
+ */
+void thr_getstackstats(thr_stack_stats_t *stats)
+{
+    if(stats != NULL)
+        get_stack_stats(stats);
+}
@@ -0,0 +1,672 @@
+/** @file tpool.c
+ *
+ *  @brief work-stealing thread pool functions
+ *
+ *  The deques follow Chase and Lev. The owner pushes and pops at bottom
+ *  with no atomic operation but the exchange that publishes bottom; a
+ *  thief reads top and bottom and takes the task at top with a compare and
+ *  exchange. The owner only races the thieves for the last task, which it
+ *  takes with the same compare and exchange. A full deque grows into an
+ *  array twice as large. The old array is kept, a thief may still be
+ *  reading it, and freed with the pool.
+ *
+ *  A worker runs its own tasks, then those of the shared queue, then
+ *  steals; after TPOOL_SPIN_COUNT rounds without a task it counts itself
+ *  in the idle workers with the queue lock held, looks for a task once
+ *  more and parks. A submitter publishes the task with a full fence and
+ *  then reads the idle count, so either the worker sees the task or the
+ *  submitter sees the worker and wakes it up. A worker waiting for tasks
+ *  from a task sleeps the same way, with the parked workers, so a task
+ *  submitted meanwhile wakes it up too.
+ *
+ *  @author Qi Liu   (ID: qiliu)
+ *  @author Kaili Li (ID: kailili)
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <syscall.h>
+#include <thread.h>
+#include <def.h>
+#include <tpool.h>
+#include <thr_internals.h>
+
+/* rounds of looking for a task before a worker parks */
+#define TPOOL_SPIN_COUNT 64
+
+/* a steal lost the race to another thread, it may try again */
+#define TPOOL_RETRY 1
+
+static void *tpool_worker_main(void *arg);
+static int tpool_next(tpool_worker_t *worker, tpool_task_t *task);
+static void tpool_run(tpool_worker_t *worker, tpool_task_t *task);
+static int tpool_done(tpool_t *pool, int nested);
+static int tpool_push(tpool_worker_t *worker, tpool_task_t *task);
+static int tpool_pop(tpool_worker_t *worker, tpool_task_t *task);
+static int tpool_steal(tpool_worker_t *victim, tpool_task_t *task);
+static int tpool_inject(tpool_t *pool, tpool_task_t *task);
+static int tpool_take_injected(tpool_t *pool, tpool_task_t *task);
+static int tpool_has_work(tpool_t *pool);
+static void tpool_park(tpool_t *pool);
+static void tpool_wake(tpool_t *pool, linklist_t *queue, int all);
+static void tpool_wake_waiters(tpool_t *pool);
+static tpool_worker_t *tpool_self(tpool_t *pool);
+static void tpool_stop(tpool_t *pool, int nstarted);
+static void tpool_free(tpool_t *pool);
+
+/** @brief create a pool
+ *
+ * @param nworkers: number of workers
+ * @param stacksize: bytes of a worker's stack allocated at once, 0 for
+ *                   the default
+ * @return the pool, NULL on error
+ **/
+tpool_t *tpool_create(int nworkers, int stacksize)
+{
+    thr_stack_policy_t policy;
+    tpool_worker_t *worker;
+    tpool_t *pool;
+    int i;
+
+    if (nworkers <= 0 || nworkers > TPOOL_MAX_WORKERS || stacksize < 0)
+        return NULL;
+
+    if (NULL == (pool = calloc(1, sizeof(tpool_t))))
+        return NULL;
+
+    pool->nworkers = nworkers;
+    pool->inject_size = TPOOL_DEQUE_SIZE;
+    linklist_init(&pool->idle_queue);
+    linklist_init(&pool->wait_queue);
+    mutex_init(&pool->inject_mutex);
+
+    pool->workers = calloc(nworkers, sizeof(tpool_worker_t));
+    pool->inject = malloc(TPOOL_DEQUE_SIZE * sizeof(tpool_task_t));
+    if (NULL == pool->workers || NULL == pool->inject) {
+        tpool_free(pool);
+        return NULL;
+    }
+
+    for (i = 0; i < nworkers; i++) {
+        worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->seed = i + 1;
+        worker->array = malloc(sizeof(tpool_array_t) +
+                               TPOOL_DEQUE_SIZE * sizeof(tpool_task_t));
+        if (NULL == worker->array) {
+            tpool_free(pool);
+            return NULL;
+        }
+        worker->array->mask = TPOOL_DEQUE_SIZE - 1;
+        worker->array->prev = NULL;
+        worker->array->tasks = (tpool_task_t *)(worker->array + 1);
+    }
+
+    /* the stack of a worker is allocated up front, not fault by fault */
+    policy = *get_stack_policy();
+    policy.prefault_pages = (stacksize + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    for (i = 0; i < nworkers; i++) {
+        pool->workers[i].tid = thr_create_policy(tpool_worker_main,
+                                                 &pool->workers[i],
+                                                 stacksize ? &policy : NULL);
+        if (pool->workers[i].tid < 0) {
+            tpool_stop(pool, i);
+            tpool_free(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+/** @brief submit a task
+ *
+ * @param pool: pool
+ * @param func: the function
+ * @param arg: argument of the function
+ * @return error or success
+ **/
+int tpool_submit(tpool_t *pool, tpool_func_t func, void *arg)
+{
+    tpool_worker_t *worker;
+    tpool_task_t task;
+    int ret;
+
+    if (NULL == func)
+        return ERROR;
+
+    task.func = func;
+    task.arg = arg;
+
+    /* counted before any worker may run it */
+    atom_add((int *)&pool->pending, 1);
+
+    worker = tpool_self(pool);
+    if (NULL == worker || tpool_push(worker, &task) < 0)
+        ret = tpool_inject(pool, &task);
+    else
+        ret = OK;
+
+    if (ret < 0) {
+        atom_add((int *)&pool->pending, -1);
+        return ERROR;
+    }
+
+    /* the task is published with a full fence, see the file comment */
+    if (0 != pool->idle)
+        tpool_wake(pool, &pool->idle_queue, 0);
+
+    return OK;
+}
+
+/** @brief wait until all submitted tasks have finished
+ *
+ * A worker of the pool runs tasks while it waits, its own deque may hold
+ * some of them. A task which waits is still pending, and so are the other
+ * tasks waiting, so from a task it waits until every task not blocked in
+ * here has finished. The tasks left return from here then, none of them
+ * waits for another.
+ *
+ * @param pool: pool
+ * @return none
+ **/
+void tpool_wait(tpool_t *pool)
+{
+    tpool_worker_t *worker = tpool_self(pool);
+    int nested = (NULL != worker && worker->depth > 0);
+    waitnode_t waiter;
+    tpool_task_t task;
+
+    /* the other tasks waiting may be waiting for this one only */
+    if (nested && atom_add((int *)&pool->nested, 1) + 1 >= pool->pending)
+        tpool_wake_waiters(pool);
+
+    while (!tpool_done(pool, nested)) {
+        if (NULL != worker && OK == tpool_next(worker, &task)) {
+            tpool_run(worker, &task);
+            continue;
+        }
+
+        waitnode_init(&waiter);
+
+        /* a worker counts itself idle, see the file comment */
+        waitq_lock(&pool->qlock);
+        if (NULL != worker)
+            atom_add((int *)&pool->idle, 1);
+        if (tpool_done(pool, nested) ||
+            (NULL != worker && tpool_has_work(pool))) {
+            if (NULL != worker)
+                atom_add((int *)&pool->idle, -1);
+            waitq_unlock(&pool->qlock);
+            continue;
+        }
+        linklist_addtail(NULL != worker ? &pool->idle_queue :
+                         &pool->wait_queue, &waiter.node);
+        waitq_unlock(&pool->qlock);
+
+        waitnode_sleep(&waiter);
+    }
+
+    if (nested)
+        atom_add((int *)&pool->nested, -1);
+
+    return;
+}
+
+/** @brief destroy a pool
+ *
+ * Wait for the tasks, then stop and join the workers. It is illegal to
+ * submit tasks meanwhile, or to call it from a worker.
+ *
+ * @param pool: pool
+ * @return none
+ **/
+void tpool_destroy(tpool_t *pool)
+{
+    tpool_wait(pool);
+    tpool_stop(pool, pool->nworkers);
+    tpool_free(pool);
+
+    return;
+}
+
+/** @brief the body of a worker thread
+ *
+ * @param arg: the worker
+ * @return NULL
+ **/
+static void *tpool_worker_main(void *arg)
+{
+    tpool_worker_t *worker = (tpool_worker_t *)arg;
+    tpool_t *pool = worker->pool;
+    thread_t *self = get_self_thread();
+    tpool_task_t task;
+    int tries = 0;
+
+    self->tpool_worker = worker;
+
+    while (1) {
+        if (OK == tpool_next(worker, &task)) {
+            tpool_run(worker, &task);
+            tries = 0;
+            continue;
+        }
+
+        if (++tries < TPOOL_SPIN_COUNT)
+            continue;
+        tries = 0;
+
+        if (pool->shutdown)
+            break;
+        tpool_park(pool);
+    }
+
+    self->tpool_worker = NULL;
+
+    return NULL;
+}
+
+/** @brief find a task for a worker
+ *
+ * Its own deque first, then the shared queue, then the other workers'
+ * deques, from a victim picked at random.
+ *
+ * @param worker: the worker
+ * @param task: where to put the task
+ * @return OK if a task was found, ERROR if not
+ **/
+static int tpool_next(tpool_worker_t *worker, tpool_task_t *task)
+{
+    tpool_t *pool = worker->pool;
+    int i, victim, ret;
+
+    if (OK == tpool_pop(worker, task))
+        return OK;
+
+    if (0 != pool->inject_count && OK == tpool_take_injected(pool, task))
+        return OK;
+
+    worker->seed = worker->seed * 1103515245 + 12345;
+    victim = (worker->seed >> 16) % pool->nworkers;
+
+    for (i = 0; i < pool->nworkers; i++, victim = (victim + 1) %
+         pool->nworkers) {
+        if (victim == worker->index)
+            continue;
+        while (TPOOL_RETRY == (ret = tpool_steal(&pool->workers[victim],
+                                                 task)))
+            continue;
+        if (OK == ret)
+            return OK;
+    }
+
+    return ERROR;
+}
+
+/** @brief run a task and count it finished
+ *
+ * @param worker: the worker, the calling thread
+ * @param task: the task
+ * @return none
+ **/
+static void tpool_run(tpool_worker_t *worker, tpool_task_t *task)
+{
+    tpool_t *pool = worker->pool;
+
+    worker->depth++;
+    task->func(task->arg);
+    worker->depth--;
+
+    /* the last task, or the last one not blocked in tpool_wait() */
+    if (atom_add((int *)&pool->pending, -1) - 1 <= pool->nested)
+        tpool_wake_waiters(pool);
+
+    return;
+}
+
+/** @brief check if the tasks a thread waits for have finished
+ *
+ * @param pool: pool
+ * @param nested: not 0 if the thread waits from a task
+ * @return 1 if the wait is over, 0 if not
+ **/
+static int tpool_done(tpool_t *pool, int nested)
+{
+    if (nested)
+        return pool->pending <= pool->nested;
+
+    return 0 == pool->pending;
+}
+
+/** @brief push a task at the bottom of the owner's deque
+ *
+ * @param worker: the owner, the calling thread
+ * @param task: the task
+ * @return error if the deque is full and can not grow
+ **/
+static int tpool_push(tpool_worker_t *worker, tpool_task_t *task)
+{
+    unsigned int bottom = worker->bottom;
+    unsigned int top = worker->top;
+    tpool_array_t *array = worker->array;
+    tpool_array_t *bigger;
+    unsigned int i;
+
+    if (bottom - top > (unsigned int)array->mask) {
+        bigger = malloc(sizeof(tpool_array_t) +
+                        (array->mask + 1) * 2 * sizeof(tpool_task_t));
+        if (NULL == bigger)
+            return ERROR;
+
+        bigger->mask = (array->mask << 1) | 1;
+        bigger->prev = array;
+        bigger->tasks = (tpool_task_t *)(bigger + 1);
+        for (i = top; i != bottom; i++)
+            bigger->tasks[i & bigger->mask] = array->tasks[i & array->mask];
+
+        /* stored before bottom, a thief which sees bottom sees the array */
+        worker->array = array = bigger;
+    }
+
+    array->tasks[bottom & array->mask] = *task;
+    atom_xchg((int *)&worker->bottom, bottom + 1);
+
+    return OK;
+}
+
+/** @brief pop the newest task of the owner's deque
+ *
+ * @param worker: the owner, the calling thread
+ * @param task: where to put the task
+ * @return OK if a task was popped, ERROR if the deque is empty
+ **/
+static int tpool_pop(tpool_worker_t *worker, tpool_task_t *task)
+{
+    unsigned int bottom = worker->bottom - 1;
+    tpool_array_t *array = worker->array;
+    unsigned int top;
+
+    /* claim the slot before looking at top, with a full fence */
+    atom_xchg((int *)&worker->bottom, bottom);
+    top = worker->top;
+
+    if ((int)(bottom - top) < 0) {
+        worker->bottom = bottom + 1;
+        return ERROR;
+    }
+
+    *task = array->tasks[bottom & array->mask];
+    if (bottom != top)
+        return OK;
+
+    /* the last task, a thief may be taking it */
+    if (top != (unsigned int)atom_cmpxchg((int *)&worker->top, top,
+                                          top + 1)) {
+        worker->bottom = bottom + 1;
+        return ERROR;
+    }
+
+    worker->bottom = bottom + 1;
+    return OK;
+}
+
+/** @brief steal the oldest task of another worker's deque
+ *
+ * @param victim: the owner of the deque
+ * @param task: where to put the task
+ * @return OK if a task was stolen, ERROR if the deque is empty,
+ *         TPOOL_RETRY if another thread took the task first
+ **/
+static int tpool_steal(tpool_worker_t *victim, tpool_task_t *task)
+{
+    unsigned int top = victim->top;
+    unsigned int bottom = victim->bottom;
+    tpool_array_t *array;
+
+    if ((int)(bottom - top) <= 0)
+        return ERROR;
+
+    /* the slot is not reused while top stays, so the copy is good if the
+     * exchange succeeds */
+    array = victim->array;
+    *task = array->tasks[top & array->mask];
+
+    if (top != (unsigned int)atom_cmpxchg((int *)&victim->top, top,
+                                          top + 1))
+        return TPOOL_RETRY;
+
+    return OK;
+}
+
+/** @brief add a task to the shared queue
+ *
+ * @param pool: pool
+ * @param task: the task
+ * @return error if the queue is full and can not grow
+ **/
+static int tpool_inject(tpool_t *pool, tpool_task_t *task)
+{
+    tpool_task_t *bigger;
+    int i;
+
+    mutex_lock(&pool->inject_mutex);
+
+    if (pool->inject_count == pool->inject_size) {
+        bigger = malloc(pool->inject_size * 2 * sizeof(tpool_task_t));
+        if (NULL == bigger) {
+            mutex_unlock(&pool->inject_mutex);
+            return ERROR;
+        }
+        for (i = 0; i < pool->inject_count; i++)
+            bigger[i] = pool->inject[(pool->inject_head + i) %
+                                     pool->inject_size];
+        free(pool->inject);
+        pool->inject = bigger;
+        pool->inject_head = 0;
+        pool->inject_size *= 2;
+    }
+
+    pool->inject[(pool->inject_head + pool->inject_count) %
+                 pool->inject_size] = *task;
+    /* publish with a full fence */
+    atom_add((int *)&pool->inject_count, 1);
+
+    mutex_unlock(&pool->inject_mutex);
+
+    return OK;
+}
+
+/** @brief take the oldest task of the shared queue
+ *
+ * @param pool: pool
+ * @param task: where to put the task
+ * @return OK if a task was taken, ERROR if the queue is empty
+ **/
+static int tpool_take_injected(tpool_t *pool, tpool_task_t *task)
+{
+    int ret = ERROR;
+
+    mutex_lock(&pool->inject_mutex);
+    if (pool->inject_count > 0) {
+        *task = pool->inject[pool->inject_head];
+        pool->inject_head = (pool->inject_head + 1) % pool->inject_size;
+        pool->inject_count--;
+        ret = OK;
+    }
+    mutex_unlock(&pool->inject_mutex);
+
+    return ret;
+}
+
+/** @brief check if any task is queued
+ *
+ * @param pool: pool
+ * @return 1 if a deque or the shared queue holds a task, 0 if not
+ **/
+static int tpool_has_work(tpool_t *pool)
+{
+    tpool_worker_t *worker;
+    int i;
+
+    if (0 != pool->inject_count)
+        return 1;
+
+    for (i = 0; i < pool->nworkers; i++) {
+        worker = &pool->workers[i];
+        if ((int)(worker->bottom - worker->top) > 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/** @brief park an idle worker until a task is submitted
+ *
+ * Return at once if a task was queued or the pool stopped after the
+ * worker counted itself in.
+ *
+ * @param pool: pool
+ * @return none
+ **/
+static void tpool_park(tpool_t *pool)
+{
+    waitnode_t waiter;
+
+    waitnode_init(&waiter);
+
+    waitq_lock(&pool->qlock);
+    atom_add((int *)&pool->idle, 1);
+    if (pool->shutdown || tpool_has_work(pool)) {
+        atom_add((int *)&pool->idle, -1);
+        waitq_unlock(&pool->qlock);
+        return;
+    }
+    linklist_addtail(&pool->idle_queue, &waiter.node);
+    waitq_unlock(&pool->qlock);
+
+    waitnode_sleep(&waiter);
+
+    return;
+}
+
+/** @brief wake one or all threads of a queue
+ *
+ * @param pool: pool
+ * @param queue: the idle queue or the wait queue
+ * @param all: wake everybody if not 0
+ * @return none
+ **/
+static void tpool_wake(tpool_t *pool, linklist_t *queue, int all)
+{
+    listnode_t *node, *next;
+    int n = 0;
+
+    waitq_lock(&pool->qlock);
+    if (all) {
+        node = linklist_delall(queue);
+    } else if (NULL != (node = linklist_delhead(queue))) {
+        node->pNext = NULL;
+    }
+    if (queue == &pool->idle_queue) {
+        for (next = node; NULL != next; next = next->pNext)
+            n++;
+        atom_add((int *)&pool->idle, -n);
+    }
+    waitq_unlock(&pool->qlock);
+
+    /* a node is gone once its thread runs, get the next one first */
+    while (NULL != node) {
+        next = node->pNext;
+        waitnode_wakeup((waitnode_t *)node->data);
+        node = next;
+    }
+
+    return;
+}
+
+/** @brief wake the threads in tpool_wait(), their wait may be over
+ *
+ * Workers waiting from a task sleep with the parked workers, so those are
+ * woken too while a task waits. The ones with nothing to do park again.
+ *
+ * @param pool: pool
+ * @return none
+ **/
+static void tpool_wake_waiters(tpool_t *pool)
+{
+    tpool_wake(pool, &pool->wait_queue, 1);
+    if (0 != pool->nested)
+        tpool_wake(pool, &pool->idle_queue, 1);
+
+    return;
+}
+
+/** @brief find the worker of a pool which is the calling thread
+ *
+ * @param pool: pool
+ * @return the worker, NULL if the caller is not a worker of the pool
+ **/
+static tpool_worker_t *tpool_self(tpool_t *pool)
+{
+    thread_t *self = get_self_thread();
+    tpool_worker_t *worker;
+
+    if (NULL == self || NULL == (worker = self->tpool_worker))
+        return NULL;
+
+    return worker->pool == pool ? worker : NULL;
+}
+
+/** @brief stop the workers and join them
+ *
+ * @param pool: pool
+ * @param nstarted: number of workers created
+ * @return none
+ **/
+static void tpool_stop(tpool_t *pool, int nstarted)
+{
+    int i;
+
+    /* a full fence, then every idle worker is woken up */
+    atom_xchg((int *)&pool->shutdown, 1);
+    tpool_wake(pool, &pool->idle_queue, 1);
+
+    for (i = 0; i < nstarted; i++)
+        thr_join(pool->workers[i].tid, NULL);
+
+    return;
+}
+
+/** @brief free a pool with no worker running
+ *
+ * @param pool: pool
+ * @return none
+ **/
+static void tpool_free(tpool_t *pool)
+{
+    tpool_array_t *array, *prev;
+    int i;
+
+    /* a worker may still be waking others up */
+    while (0 != *(volatile int *)&pool->qlock)
+        yield(-1);
+
+    if (NULL != pool->workers) {
+        for (i = 0; i < pool->nworkers; i++) {
+            for (array = pool->workers[i].array; NULL != array;
+                 array = prev) {
+                prev = array->prev;
+                free(array);
+            }
+        }
+        free(pool->workers);
+    }
+
+    free(pool->inject);
+    mutex_destroy(&pool->inject_mutex);
+    free(pool);
+
+    return;
+}
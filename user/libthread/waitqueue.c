@@ -0,0 +1,120 @@
+/** @file waitqueue.c
+ *
+ *  @brief wait queue helpers shared by the synchronization primitives
+ *
+ *  A thread which has to block puts a wait node on its own stack, links it
+ *  into the queue of the primitive and deschedules itself. The thread which
+ *  removes the node from the queue makes it runnable. The node is only valid
+ *  until the waiter is runnable again, so the waker must not touch it after
+ *  waitnode_wakeup(). The waiter only leaves once the waker has set woken
+ *  in the node, so a make_runnable() meant for something else can not end
+ *  its wait.
+ *
+ *  A fiber blocks the same way, but switches to the next fiber of its
+ *  thread instead of descheduling, and is put back in the run queue of the
+ *  thread when woken up.
+ *
+ *  @author Qi Liu   (ID: qiliu)
+ *  @author Kaili Li (ID: kailili)
+ */
+
+#include<stddef.h>
+#include<syscall.h>
+#include<def.h>
+#include<thr_internals.h>
+
+/* queue lock is free or held */
+#define QUEUE_LOCK_NO 0
+#define QUEUE_LOCK_YES 1
+
+/** @brief lock a wait queue
+ *  
+ * The queue lock is only held for a few instructions, so we just yield if
+ * somebody else holds it.
+ *
+ * @param qlock: the lock word of the queue
+ * @return none
+ **/
+void waitq_lock(int *qlock)
+{
+    while (QUEUE_LOCK_NO != atom_xchg(qlock, QUEUE_LOCK_YES))
+        yield(-1);
+
+    return;
+}
+
+/** @brief unlock a wait queue
+ *  
+ * @param qlock: the lock word of the queue
+ * @return none
+ **/
+void waitq_unlock(int *qlock)
+{
+    atom_xchg(qlock, QUEUE_LOCK_NO);
+
+    return;
+}
+
+/** @brief init a wait node for the calling thread
+ *  
+ * @param waiter: wait node, on the stack of the calling thread
+ * @return none
+ **/
+void waitnode_init(waitnode_t *waiter)
+{
+    waiter->node.pNext = NULL;
+    waiter->node.data = (void *)waiter;
+    waiter->tid = get_self_tid();
+    waiter->mp = NULL;
+    waiter->locked = 0;
+    waiter->woken = 0;
+    waiter->fiber = fiber_self();
+
+    return;
+}
+
+/** @brief block the calling thread until its wait node is woken up
+ *  
+ * The node must have been linked into a queue, and the queue unlocked. A
+ * wakeup which is not from waitnode_wakeup() is ignored.
+ *
+ * @param waiter: wait node of the calling thread
+ * @return none
+ **/
+void waitnode_sleep(waitnode_t *waiter)
+{
+    if (NULL != waiter->fiber) {
+        fiber_park(waiter->fiber);
+        return;
+    }
+
+    /* deschedule returns at once if woken is already set */
+    while (!waiter->woken)
+        deschedule((int *)&waiter->woken);
+
+    return;
+}
+
+/** @brief wake up the thread of a wait node
+ *  
+ * The node must have been removed from its queue by the caller. Once woken
+ * is set the node may be gone, and the waiter either is descheduled or sees
+ * woken and does not deschedule, so one make_runnable() is enough.
+ *
+ * @param waiter: wait node
+ * @return none
+ **/
+void waitnode_wakeup(waitnode_t *waiter)
+{
+    int tid = waiter->tid;
+
+    if (NULL != waiter->fiber) {
+        fiber_wake(waiter->fiber);
+        return;
+    }
+
+    waiter->woken = 1;
+    make_runnable(tid);
+
+    return;
+}
@@ -0,0 +1,218 @@
+/** @file bench.h
+ *  @brief Common code of the bench_* programs.
+ *
+ *  Every result is printed as one line of key=value pairs:
+ *
+ *    BENCH bench=mutex case=contended threads=4 ops=200000 ticks=57
+ *          ops_per_sec=3508771 ns_per_op=285
+ *
+ *  (on one line), so a script can grep for "^BENCH" and compare runs.
+ *  ops_per_sec assumes BENCH_TICKS_PER_SEC ticks a second; build with
+ *  -DBENCH_TICKS_PER_SEC=n for a kernel with another timer rate. Each
+ *  program takes an optional argument, a percentage to scale the work by
+ *  (100 by default), to keep runs short under the simulator.
+ *
+ *  A program which defines BENCH_ALLOCS before including this file also
+ *  gets the allocation counters of the library, when it is built with
+ *  MALLOC_STATS.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <thread.h>
+#include <barrier.h>
+#ifdef BENCH_ALLOCS
+#include <malloc_stats.h>
+#endif
+
+#ifndef BENCH_TICKS_PER_SEC
+#define BENCH_TICKS_PER_SEC 1000
+#endif
+
+/* Stack size given to thr_init(), a program may define its own */
+#ifndef BENCH_STACK_SIZE
+#define BENCH_STACK_SIZE (64 * 1024)
+#endif
+
+/* Thread counts of a sweep */
+#define BENCH_SWEEP 4
+static int bench_sweep[BENCH_SWEEP] = {1, 2, 4, 8};
+
+/* Most threads of one run */
+#define BENCH_MAX_THREADS 16
+
+static int bench_scale = 100;
+
+/* A run: the worker function, its argument, and the start barrier */
+typedef struct {
+    void (*func)(int id, void *arg);
+    void *arg;
+    barrier_t start;
+} bench_run_t;
+
+typedef struct {
+    bench_run_t *run;
+    int id;
+} bench_worker_t;
+
+/** @brief Parse the arguments and start the thread library
+ *
+ *  @param argc number of arguments
+ *  @param argv arguments, argv[1] the work scale in percent
+ *  @return Void
+ */
+static void bench_init(int argc, char *argv[])
+{
+    if(argc > 1 && atoi(argv[1]) > 0)
+        bench_scale = atoi(argv[1]);
+
+    if(thr_init(BENCH_STACK_SIZE) < 0){
+        printf("BENCH error=thr_init\n");
+        exit(-1);
+    }
+}
+
+/** @brief Scale a number of operations
+ *
+ *  @param ops operations at scale 100
+ *  @return operations at the current scale, at least 1
+ */
+static int bench_ops(int ops)
+{
+    int n = ops / 100 * bench_scale + ops % 100 * bench_scale / 100;
+
+    return n > 0 ? n : 1;
+}
+
+/** @brief Print a result
+ *
+ *  @param bench name of the program
+ *  @param name name of the case
+ *  @param threads number of threads of the case
+ *  @param ops operations done
+ *  @param ticks ticks taken
+ *  @return Void
+ */
+static void bench_report(const char *bench, const char *name, int threads,
+                         int ops, int ticks)
+{
+    int t = ticks > 0 ? ticks : 1;
+    int rate;
+
+    /* no 64-bit division: split ops into whole and remaining ticks */
+    rate = ops / t * BENCH_TICKS_PER_SEC +
+           ops % t * BENCH_TICKS_PER_SEC / t;
+
+    printf("BENCH bench=%s case=%s threads=%d ops=%d ticks=%d "
+           "ops_per_sec=%d ns_per_op=%d\n", bench, name, threads, ops,
+           ticks, rate, rate > 0 ? 1000000000 / rate : 0);
+}
+
+/** @brief Start a worker and run its function after the start barrier
+ *
+ *  @param arg the worker
+ *  @return NULL
+ */
+static void *bench_worker(void *arg)
+{
+    bench_worker_t *worker = arg;
+    bench_run_t *run = worker->run;
+
+    barrier_wait(&run->start);
+    run->func(worker->id, run->arg);
+
+    return NULL;
+}
+
+/** @brief Run func(id, arg) in nthreads threads at once
+ *
+ *  The clock starts when the last thread is created and stops when all
+ *  are joined.
+ *
+ *  @param nthreads number of threads
+ *  @param func the work of a thread
+ *  @param arg argument of func
+ *  @return ticks taken
+ */
+static int bench_run(int nthreads, void (*func)(int, void *), void *arg)
+{
+    bench_worker_t workers[BENCH_MAX_THREADS];
+    int tids[BENCH_MAX_THREADS];
+    bench_run_t run;
+    int i, start;
+
+    run.func = func;
+    run.arg = arg;
+    barrier_init(&run.start, nthreads + 1);
+
+    for(i = 0; i < nthreads; i++){
+        workers[i].run = &run;
+        workers[i].id = i;
+        tids[i] = thr_create(bench_worker, &workers[i]);
+        if(tids[i] < 0){
+            printf("BENCH error=thr_create\n");
+            exit(-1);
+        }
+    }
+
+    barrier_wait(&run.start);
+    start = get_ticks();
+    for(i = 0; i < nthreads; i++)
+        thr_join(tids[i], NULL);
+
+    barrier_destroy(&run.start);
+
+    return get_ticks() - start;
+}
+
+#ifdef BENCH_ALLOCS
+
+/** @brief Count the allocations and frees of the library so far
+ *
+ *  @param frees where to put the frees
+ *  @return allocations, negative without MALLOC_STATS
+ */
+static int bench_count_allocs(int *frees)
+{
+    malloc_stats_t stats;
+    int allocs = 0, i;
+
+    *frees = 0;
+    if(malloc_stats(&stats, NULL) < 0)
+        return -1;
+
+    for(i = 0; i < MALLOC_STATS_BUCKETS; i++)
+        allocs += stats.allocs[i];
+    *frees = stats.frees;
+
+    return allocs;
+}
+
+/** @brief Print the allocations and frees of a run
+ *
+ *  @param bench name of the program
+ *  @param name name of the case
+ *  @param threads number of threads of the case
+ *  @param ops operations done
+ *  @param allocs allocations during the run
+ *  @param frees frees during the run
+ *  @return Void
+ */
+static void bench_report_allocs(const char *bench, const char *name,
+                                int threads, int ops, int allocs, int frees)
+{
+    printf("BENCH bench=%s case=%s threads=%d ops=%d allocs=%d frees=%d "
+           "allocs_per_op=%d\n", bench, name, threads, ops, allocs, frees,
+           ops > 0 ? allocs / ops : 0);
+}
+
+#endif /* BENCH_ALLOCS */
+
+#endif /* _BENCH_H */
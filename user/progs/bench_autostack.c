@@ -0,0 +1,157 @@
+/** @file bench_autostack.c
+ *  @brief Benchmark stack growth faults.
+ *
+ *  A thread recurses DEPTH levels of a bit over a page each, so its stack
+ *  grows by a page per level (cold), then does it again on the grown
+ *  stack (warm). The difference is the cost of the faults. Reaped stacks
+ *  are trimmed, so the threads of each round start small again. It is run
+ *  with each growth policy; the ticks of a case are those of its slowest
+ *  thread.
+ *
+ *  The depth cases sweep the recursion depth with one thread and report
+ *  the growth faults a thread took per round with the cold ticks.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#define BENCH_STACK_SIZE (1024 * 1024)
+
+#include <thrstack.h>
+#include "bench.h"
+
+#define BENCH "autostack"
+#define DEPTH 200
+#define ROUNDS 50
+
+#define DEPTHS 5
+static int depths[DEPTHS] = {8, 32, 64, 128, DEPTH};
+
+#define POLICIES 3
+static const char *policy_names[POLICIES] = {"default", "fixed8", "double"};
+static thr_stack_policy_t policies[POLICIES] = {
+    {THR_STACK_GROW_FIXED, 0, 0, 0},
+    {THR_STACK_GROW_FIXED, 8, 0, 0},
+    {THR_STACK_GROW_DOUBLE, 1, 64, 0},
+};
+
+static int cold_ticks[BENCH_MAX_THREADS];
+static int warm_ticks[BENCH_MAX_THREADS];
+static int faults[BENCH_MAX_THREADS];
+static int depth;
+
+/** @brief Recurse with a page of stack per level
+ *
+ *  @param levels levels to go
+ *  @return something the compiler can not drop
+ */
+static int descend(int levels)
+{
+    volatile char frame[PAGE_SIZE];
+
+    frame[0] = levels;
+    if(levels > 1)
+        return descend(levels - 1) + frame[0];
+    return frame[0];
+}
+
+/** @brief Grow the stack, then use the grown stack
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void grow(int id, void *arg)
+{
+    int t0, t1, t2, f0;
+
+    f0 = thr_getstackfaults();
+    t0 = get_ticks();
+    descend(depth);
+    t1 = get_ticks();
+    descend(depth);
+    t2 = get_ticks();
+
+    faults[id] += thr_getstackfaults() - f0;
+    cold_ticks[id] += t1 - t0;
+    warm_ticks[id] += t2 - t1;
+}
+
+/** @brief Ticks of the slowest thread
+ *
+ *  @param ticks ticks of each thread
+ *  @param n number of threads
+ *  @return the largest
+ */
+static int slowest(int *ticks, int n)
+{
+    int i, max = 0;
+
+    for(i = 0; i < n; i++){
+        if(ticks[i] > max)
+            max = ticks[i];
+    }
+    return max;
+}
+
+/** @brief Sweep the recursion depth with one thread under each policy
+ *
+ *  @param rounds rounds of each depth
+ *  @return Void
+ */
+static void depth_sweep(int rounds)
+{
+    int p, i, r, ticks;
+
+    for(p = 0; p < POLICIES; p++){
+        thr_setstackpolicy(&policies[p]);
+        for(i = 0; i < DEPTHS; i++){
+            depth = depths[i];
+            cold_ticks[0] = warm_ticks[0] = faults[0] = 0;
+
+            for(r = 0; r < rounds; r++)
+                bench_run(1, grow, NULL);
+
+            ticks = cold_ticks[0];
+            printf("BENCH bench=%s case=depth_%s threads=1 depth=%d "
+                   "ops=%d ticks=%d faults_per_round=%d\n", BENCH,
+                   policy_names[p], depth, rounds * depth, ticks,
+                   faults[0] / rounds);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char name[32];
+    int rounds, n, i, p, r;
+
+    bench_init(argc, argv);
+    rounds = bench_ops(ROUNDS);
+    thr_setstacktrim(0);
+    depth = DEPTH;
+
+    for(p = 0; p < POLICIES; p++){
+        thr_setstackpolicy(&policies[p]);
+        for(i = 0; i < BENCH_SWEEP; i++){
+            n = bench_sweep[i];
+            for(r = 0; r < n; r++)
+                cold_ticks[r] = warm_ticks[r] = 0;
+
+            for(r = 0; r < rounds; r++)
+                bench_run(n, grow, NULL);
+
+            snprintf(name, sizeof(name), "cold_%s", policy_names[p]);
+            bench_report(BENCH, name, n, rounds * DEPTH * n,
+                         slowest(cold_ticks, n));
+            snprintf(name, sizeof(name), "warm_%s", policy_names[p]);
+            bench_report(BENCH, name, n, rounds * DEPTH * n,
+                         slowest(warm_ticks, n));
+        }
+    }
+
+    depth_sweep(rounds);
+
+    return 0;
+}
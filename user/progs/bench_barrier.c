@@ -0,0 +1,63 @@
+/** @file bench_barrier.c
+ *  @brief Benchmark barrier phases.
+ *
+ *  All threads wait at one barrier over and over; an op is one phase. The
+ *  sweep is doubled, a barrier of 1 thread would never block.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include "bench.h"
+
+#define BENCH "barrier"
+#define OPS 100000
+
+static barrier_t barrier;
+static int phases;
+static int serial_count[BENCH_MAX_THREADS];
+
+/** @brief Go through the phases
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void phase(int id, void *arg)
+{
+    int i;
+
+    for(i = 0; i < phases; i++){
+        if(barrier_wait(&barrier) == BARRIER_SERIAL_THREAD)
+            serial_count[id]++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int ticks, n, i, j, serial;
+
+    bench_init(argc, argv);
+    phases = bench_ops(OPS);
+
+    for(j = 0; j < BENCH_SWEEP; j++){
+        n = bench_sweep[j] * 2;
+        barrier_init(&barrier, n);
+        for(i = 0; i < n; i++)
+            serial_count[i] = 0;
+
+        ticks = bench_run(n, phase, NULL);
+
+        /* one thread of each phase is told it was the last */
+        for(serial = 0, i = 0; i < n; i++)
+            serial += serial_count[i];
+        if(serial != phases)
+            printf("BENCH bench=%s error=serial\n", BENCH);
+
+        bench_report(BENCH, "phase", n, phases, ticks);
+        barrier_destroy(&barrier);
+    }
+
+    return 0;
+}
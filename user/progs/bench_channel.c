@@ -0,0 +1,138 @@
+/** @file bench_channel.c
+ *  @brief Benchmark channels between senders and receivers.
+ *
+ *  Items go through one channel of CAPACITY slots. 1_1 is one sender and
+ *  one receiver, n_1 is n senders and one receiver, n_n is n of each. The
+ *  batch cases move BATCH items per call with channel_send_n() and
+ *  channel_recv_n(). Every item is checked to come out once.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <channel.h>
+#include "bench.h"
+
+#define BENCH "channel"
+#define OPS 1000000
+#define CAPACITY 64
+#define BATCH 16
+
+static channel_t channel;
+static int senders, receivers;
+static int items_per_sender, items_per_receiver;
+static int batch;
+static unsigned int sums[BENCH_MAX_THREADS];
+
+/** @brief Send items 1 .. items_per_sender, batch at a time
+ *
+ *  @return Void
+ */
+static void send_items(void)
+{
+    void *items[BATCH];
+    int i, j;
+
+    for(i = 0; i < items_per_sender; i += batch){
+        for(j = 0; j < batch; j++)
+            items[j] = (void *)(i + j + 1);
+        channel_send_n(&channel, items, batch);
+    }
+}
+
+/** @brief Receive items, batch at a time, and add them up
+ *
+ *  @param id worker index
+ *  @return Void
+ */
+static void receive_items(int id)
+{
+    void *items[BATCH];
+    unsigned int sum = 0;
+    int i, j;
+
+    for(i = 0; i < items_per_receiver; i += batch){
+        channel_recv_n(&channel, items, batch);
+        for(j = 0; j < batch; j++)
+            sum += (unsigned int)items[j];
+    }
+
+    sums[id] = sum;
+}
+
+/** @brief The first senders threads send, the rest receive
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void worker(int id, void *arg)
+{
+    if(id < senders)
+        send_items();
+    else
+        receive_items(id);
+}
+
+/** @brief Run a case
+ *
+ *  @param name name of the case
+ *  @param nsend number of senders
+ *  @param nrecv number of receivers
+ *  @param ops items to move
+ *  @return Void
+ */
+static void run(const char *name, int nsend, int nrecv, int ops)
+{
+    unsigned int sum = 0, expect, items;
+    int ticks, i;
+
+    senders = nsend;
+    receivers = nrecv;
+    /* every sender and every receiver moves whole batches */
+    items_per_sender = ops / (nsend * nrecv * batch) * nrecv * batch;
+    items_per_receiver = items_per_sender * nsend / nrecv;
+
+    channel_init(&channel, CAPACITY);
+    ticks = bench_run(nsend + nrecv, worker, NULL);
+    channel_destroy(&channel);
+
+    for(i = nsend; i < nsend + nrecv; i++)
+        sum += sums[i];
+    items = items_per_sender;
+    if(items % 2 == 0)
+        expect = nsend * (items / 2) * (items + 1);
+    else
+        expect = nsend * items * ((items + 1) / 2);
+    if(sum != expect)
+        printf("BENCH bench=%s error=sum\n", BENCH);
+
+    bench_report(BENCH, name, nsend + nrecv, items_per_sender * nsend, ticks);
+}
+
+int main(int argc, char *argv[])
+{
+    char name[32];
+    int ops, n, i, b;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    for(b = 0; b < 2; b++){
+        batch = b ? BATCH : 1;
+
+        snprintf(name, sizeof(name), "1_1%s", b ? "_batch" : "");
+        run(name, 1, 1, ops);
+
+        for(i = 1; i < BENCH_SWEEP; i++){
+            n = bench_sweep[i];
+            snprintf(name, sizeof(name), "n_1%s", b ? "_batch" : "");
+            run(name, n, 1, ops);
+            snprintf(name, sizeof(name), "n_n%s", b ? "_batch" : "");
+            run(name, n, n, ops);
+        }
+    }
+
+    return 0;
+}
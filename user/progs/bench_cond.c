@@ -0,0 +1,92 @@
+/** @file bench_cond.c
+ *  @brief Benchmark condition variables with a ping-pong.
+ *
+ *  Two threads of a pair take turns: each waits on the condition variable
+ *  until the turn is its own, flips the turn and signals. An op is one
+ *  turn. The sweep runs several pairs at once.
+ *
+ *  Built with MALLOC_STATS, each case also reports the allocations and
+ *  frees of the library during the run, per op; a wait and a signal take
+ *  none, so they only come from starting the threads.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#define BENCH_ALLOCS
+
+#include <mutex.h>
+#include <cond.h>
+#include "bench.h"
+
+#define BENCH "cond"
+#define OPS 200000
+
+typedef struct {
+    mutex_t mutex;
+    cond_t cond;
+    int turn;
+} pair_t;
+
+static pair_t pairs[BENCH_MAX_THREADS / 2];
+static int turns;
+
+/** @brief Play one side of a pair
+ *
+ *  @param id worker index, pair id / 2, side id % 2
+ *  @param arg unused
+ *  @return Void
+ */
+static void ping_pong(int id, void *arg)
+{
+    pair_t *pair = &pairs[id / 2];
+    int side = id % 2;
+    int i;
+
+    mutex_lock(&pair->mutex);
+    for(i = 0; i < turns; i++){
+        while(pair->turn != side)
+            cond_wait(&pair->cond, &pair->mutex);
+        pair->turn = !side;
+        cond_signal(&pair->cond);
+    }
+    mutex_unlock(&pair->mutex);
+}
+
+int main(int argc, char *argv[])
+{
+    int ops, ticks, n, i, j;
+    int allocs, frees, frees_before;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        for(j = 0; j < n; j++){
+            mutex_init(&pairs[j].mutex);
+            cond_init(&pairs[j].cond);
+            pairs[j].turn = 0;
+        }
+
+        /* each side of a pair takes half of its turns */
+        turns = ops / n / 2;
+        allocs = bench_count_allocs(&frees_before);
+        ticks = bench_run(n * 2, ping_pong, NULL);
+        bench_report(BENCH, "ping_pong", n * 2, turns * 2 * n, ticks);
+
+        if(allocs >= 0){
+            allocs = bench_count_allocs(&frees) - allocs;
+            bench_report_allocs(BENCH, "ping_pong_allocs", n * 2,
+                                turns * 2 * n, allocs, frees - frees_before);
+        }
+
+        for(j = 0; j < n; j++){
+            cond_destroy(&pairs[j].cond);
+            mutex_destroy(&pairs[j].mutex);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+/** @file bench_fiber.c
+ *  @brief Benchmark switching between fibers against threads.
+ *
+ *  An op is one switch. thr_yield is two threads calling thr_yield() over
+ *  and over; fiber_yield is two fibers calling fiber_yield() on each of n
+ *  threads. sem_thread and sem_fiber pass a token back and forth between
+ *  two threads, or two fibers of one thread, with two semaphores, so the
+ *  fibers block and are woken through the library. tpool_future has WAITERS
+ *  fibers of one thread wait on futures set by thread pool tasks, so other
+ *  threads wake them; an op is one task. spawn runs SPAWN fibers at once on
+ *  one thread, each yields once; an op is one fiber.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <sem.h>
+#include <fiber.h>
+#include <future.h>
+#include <tpool.h>
+#include "bench.h"
+
+#define BENCH "fiber"
+#define OPS 1000000
+#define SEM_OPS 200000
+#define SPAWN 20000
+#define TASK_OPS 100000
+#define WAITERS 64
+#define WORKERS 2
+
+static int switches;
+static sem_t ping, pong;
+static int spawned[BENCH_MAX_THREADS];
+static int failures;
+static tpool_t *pool;
+
+/** @brief Yield to the other thread
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void thread_yield(int id, void *arg)
+{
+    int i;
+
+    for(i = 0; i < switches; i++)
+        thr_yield(-1);
+}
+
+/** @brief Yield to the other fiber
+ *
+ *  @param arg unused
+ *  @return Void
+ */
+static void fiber_yields(void *arg)
+{
+    int i;
+
+    for(i = 0; i < switches; i++)
+        fiber_yield();
+}
+
+/** @brief Pass the token to the other side and wait for it back
+ *
+ *  @param id 0 starts with the token
+ *  @return Void
+ */
+static void pass_token(int id)
+{
+    int i;
+
+    for(i = 0; i < switches; i++){
+        if(id == 0){
+            sem_signal(&ping);
+            sem_wait(&pong);
+        } else {
+            sem_wait(&ping);
+            sem_signal(&pong);
+        }
+    }
+}
+
+/** @brief A thread passing the token
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void thread_token(int id, void *arg)
+{
+    pass_token(id);
+}
+
+/** @brief A fiber passing the token
+ *
+ *  @param arg index of the fiber
+ *  @return Void
+ */
+static void fiber_token(void *arg)
+{
+    pass_token((int)arg);
+}
+
+/** @brief A task, set its future to its own address
+ *
+ *  @param arg the future
+ *  @return Void
+ */
+static void task(void *arg)
+{
+    future_set((future_t *)arg, arg);
+}
+
+/** @brief A fiber which waits for the tasks it submits one at a time
+ *
+ *  @param arg unused
+ *  @return Void
+ */
+static void fiber_tasks(void *arg)
+{
+    future_t future;
+    int i;
+
+    for(i = 0; i < switches; i++){
+        future_init(&future);
+        if(tpool_submit(pool, task, &future) < 0 ||
+           future_get(&future) != &future){
+            failures++;
+            return;
+        }
+        future_destroy(&future);
+    }
+}
+
+/** @brief A fiber which yields once and counts itself
+ *
+ *  @param arg the counter of its thread
+ *  @return Void
+ */
+static void fiber_spawned(void *arg)
+{
+    fiber_yield();
+    (*(int *)arg)++;
+}
+
+/** @brief Create the fibers of a case on this thread and run them
+ *
+ *  @param id worker index
+ *  @param arg case: 0 yield, 1 token, 2 tasks, 3 spawn
+ *  @return Void
+ */
+static void run_fibers(int id, void *arg)
+{
+    int i, ret = 0;
+
+    switch((int)arg){
+    case 0:
+        ret = fiber_create(fiber_yields, NULL) |
+              fiber_create(fiber_yields, NULL);
+        break;
+    case 1:
+        ret = fiber_create(fiber_token, (void *)0) |
+              fiber_create(fiber_token, (void *)1);
+        break;
+    case 2:
+        for(i = 0; i < WAITERS && ret == 0; i++)
+            ret = fiber_create(fiber_tasks, NULL);
+        break;
+    default:
+        for(i = 0; i < switches && ret == 0; i++)
+            ret = fiber_create(fiber_spawned, &spawned[id]);
+        break;
+    }
+
+    if(ret < 0)
+        failures++;
+    fiber_run();
+}
+
+int main(int argc, char *argv[])
+{
+    int ops, ticks, n, i;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    switches = ops / 2;
+    ticks = bench_run(2, thread_yield, NULL);
+    bench_report(BENCH, "thr_yield", 2, switches * 2, ticks);
+
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        switches = ops / n / 2;
+        ticks = bench_run(n, run_fibers, (void *)0);
+        bench_report(BENCH, "fiber_yield", n, switches * 2 * n, ticks);
+    }
+
+    sem_init(&ping, 0);
+    sem_init(&pong, 0);
+    switches = bench_ops(SEM_OPS) / 2;
+
+    ticks = bench_run(2, thread_token, NULL);
+    bench_report(BENCH, "sem_thread", 2, switches * 2, ticks);
+
+    ticks = bench_run(1, run_fibers, (void *)1);
+    bench_report(BENCH, "sem_fiber", 1, switches * 2, ticks);
+
+    sem_destroy(&ping);
+    sem_destroy(&pong);
+
+    if((pool = tpool_create(WORKERS, 0)) == NULL){
+        printf("BENCH bench=%s error=tpool_create\n", BENCH);
+        return -1;
+    }
+    switches = bench_ops(TASK_OPS) / WAITERS;
+    ticks = bench_run(1, run_fibers, (void *)2);
+    bench_report(BENCH, "tpool_future", 1, switches * WAITERS, ticks);
+    tpool_destroy(pool);
+
+    switches = bench_ops(SPAWN);
+    ticks = bench_run(1, run_fibers, (void *)3);
+    if(spawned[0] != switches)
+        printf("BENCH bench=%s error=spawn ran=%d\n", BENCH, spawned[0]);
+    bench_report(BENCH, "spawn", 1, switches, ticks);
+
+    if(failures != 0)
+        printf("BENCH bench=%s error=failures\n", BENCH);
+
+    return 0;
+}
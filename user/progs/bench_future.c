@@ -0,0 +1,288 @@
+/** @file bench_future.c
+ *  @brief Benchmark getting results back with futures.
+ *
+ *  An op is one result. join gets it as the exit status of a thread with
+ *  thr_join(), BATCH threads at a time, as the baseline; thread_future has
+ *  each thread set a future on the stack of the main thread instead. The
+ *  tpool cases run a task per result on a pool: get waits for all of a
+ *  batch with future_wait_all(), any takes the results as they come with
+ *  future_wait_any(). nested has each task submit a child task for the
+ *  result and block on its future, as an executor layered on the pool
+ *  would; fewer tasks than workers block at once, so a worker is left to
+ *  run the children. Every result is checked.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <future.h>
+#include <tpool.h>
+#include "bench.h"
+
+#define BENCH "future"
+#define OPS 200000
+#define THREAD_OPS 20000
+#define BATCH 64
+
+typedef struct {
+    future_t *future;
+    int value;
+} job_t;
+
+static tpool_t *pool;
+static int nworkers;
+static int nresults;
+static int errors;
+
+/** @brief A task, set its future to twice its value
+ *
+ *  @param arg the job
+ *  @return Void
+ */
+static void job(void *arg)
+{
+    job_t *j = (job_t *)arg;
+
+    future_set(j->future, (void *)(j->value * 2));
+}
+
+/** @brief A task, get the result from a child task and pass it on
+ *
+ *  @param arg the job
+ *  @return Void
+ */
+static void parent_job(void *arg)
+{
+    job_t *j = (job_t *)arg;
+    future_t future;
+    job_t child;
+
+    future_init(&future);
+    child.future = &future;
+    child.value = j->value;
+    if(tpool_submit(pool, job, &child) < 0){
+        printf("BENCH bench=%s error=submit\n", BENCH);
+        exit(-1);
+    }
+    future_set(j->future, future_get(&future));
+    future_destroy(&future);
+}
+
+/** @brief A thread returning twice its value
+ *
+ *  @param arg the value
+ *  @return twice the value
+ */
+static void *job_exit(void *arg)
+{
+    return (void *)((int)arg * 2);
+}
+
+/** @brief A thread running a job
+ *
+ *  @param arg the job
+ *  @return NULL
+ */
+static void *job_thread(void *arg)
+{
+    job(arg);
+    return NULL;
+}
+
+/** @brief Check a result
+ *
+ *  @param value index of the job
+ *  @param result the result
+ *  @return Void
+ */
+static void check(int value, void *result)
+{
+    if((int)result != value * 2)
+        errors++;
+}
+
+/** @brief Get results as exit statuses
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void run_join(int id, void *arg)
+{
+    int tids[BATCH];
+    void *status;
+    int i, j, n;
+
+    for(i = 0; i < nresults; i += n){
+        n = nresults - i < BATCH ? nresults - i : BATCH;
+        for(j = 0; j < n; j++){
+            if((tids[j] = thr_create(job_exit, (void *)(i + j))) < 0){
+                printf("BENCH bench=%s error=thr_create\n", BENCH);
+                exit(-1);
+            }
+        }
+        for(j = 0; j < n; j++){
+            thr_join(tids[j], &status);
+            check(i + j, status);
+        }
+    }
+}
+
+/** @brief Get results from threads through futures
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void run_thread_future(int id, void *arg)
+{
+    future_t futures[BATCH];
+    job_t jobs[BATCH];
+    int tids[BATCH];
+    int i, j, n;
+
+    for(i = 0; i < nresults; i += n){
+        n = nresults - i < BATCH ? nresults - i : BATCH;
+        for(j = 0; j < n; j++){
+            future_init(&futures[j]);
+            jobs[j].future = &futures[j];
+            jobs[j].value = i + j;
+            if((tids[j] = thr_create(job_thread, &jobs[j])) < 0){
+                printf("BENCH bench=%s error=thr_create\n", BENCH);
+                exit(-1);
+            }
+        }
+        for(j = 0; j < n; j++)
+            check(i + j, future_get(&futures[j]));
+        for(j = 0; j < n; j++){
+            thr_join(tids[j], NULL);
+            future_destroy(&futures[j]);
+        }
+    }
+}
+
+/** @brief Get results from pool tasks, a batch at a time
+ *
+ *  @param id worker index
+ *  @param arg 0 to wait for a whole batch, 1 for any result
+ *  @return Void
+ */
+static void run_tpool(int id, void *arg)
+{
+    future_t futures[BATCH];
+    future_t *waiting[BATCH];
+    job_t jobs[BATCH];
+    int i, j, k, n, left;
+
+    for(i = 0; i < nresults; i += n){
+        n = nresults - i < BATCH ? nresults - i : BATCH;
+        for(j = 0; j < n; j++){
+            future_init(&futures[j]);
+            waiting[j] = &futures[j];
+            jobs[j].future = &futures[j];
+            jobs[j].value = i + j;
+            if(tpool_submit(pool, job, &jobs[j]) < 0){
+                printf("BENCH bench=%s error=submit\n", BENCH);
+                exit(-1);
+            }
+        }
+
+        if(arg == NULL){
+            future_wait_all(waiting, n);
+        } else {
+            /* take a result and move the last future waited on to its slot */
+            for(left = n; left > 0; left--){
+                if((k = future_wait_any(waiting, left)) < 0){
+                    printf("BENCH bench=%s error=wait_any\n", BENCH);
+                    exit(-1);
+                }
+                waiting[k] = waiting[left - 1];
+            }
+        }
+
+        for(j = 0; j < n; j++){
+            check(i + j, future_get(&futures[j]));
+            future_destroy(&futures[j]);
+        }
+    }
+}
+
+/** @brief Get results from pool tasks which wait for child tasks
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void run_nested(int id, void *arg)
+{
+    future_t futures[BATCH];
+    future_t *waiting[BATCH];
+    job_t jobs[BATCH];
+    int i, j, n, batch;
+
+    /* a worker blocked on a child needs another one free to run it */
+    batch = nworkers - 1 < BATCH ? nworkers - 1 : BATCH;
+
+    for(i = 0; i < nresults; i += n){
+        n = nresults - i < batch ? nresults - i : batch;
+        for(j = 0; j < n; j++){
+            future_init(&futures[j]);
+            waiting[j] = &futures[j];
+            jobs[j].future = &futures[j];
+            jobs[j].value = i + j;
+            if(tpool_submit(pool, parent_job, &jobs[j]) < 0){
+                printf("BENCH bench=%s error=submit\n", BENCH);
+                exit(-1);
+            }
+        }
+
+        future_wait_all(waiting, n);
+        for(j = 0; j < n; j++){
+            check(i + j, future_get(&futures[j]));
+            future_destroy(&futures[j]);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int ticks, n, i;
+
+    bench_init(argc, argv);
+
+    nresults = bench_ops(THREAD_OPS);
+    ticks = bench_run(1, run_join, NULL);
+    bench_report(BENCH, "join", 1, nresults, ticks);
+
+    ticks = bench_run(1, run_thread_future, NULL);
+    bench_report(BENCH, "thread_future", 1, nresults, ticks);
+
+    nresults = bench_ops(OPS);
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        if((pool = tpool_create(n, 0)) == NULL){
+            printf("BENCH bench=%s error=tpool_create\n", BENCH);
+            return -1;
+        }
+
+        ticks = bench_run(1, run_tpool, NULL);
+        bench_report(BENCH, "tpool_all", n, nresults, ticks);
+
+        ticks = bench_run(1, run_tpool, (void *)1);
+        bench_report(BENCH, "tpool_any", n, nresults, ticks);
+
+        if(n > 1){
+            nworkers = n;
+            ticks = bench_run(1, run_nested, NULL);
+            bench_report(BENCH, "tpool_nested", n, nresults, ticks);
+        }
+
+        tpool_destroy(pool);
+    }
+
+    if(errors != 0)
+        printf("BENCH bench=%s error=results bad=%d\n", BENCH, errors);
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+/** @file bench_malloc.c
+ *  @brief Benchmark the allocators as threads are added.
+ *
+ *  Each thread keeps WINDOW blocks alive and replaces the oldest one with
+ *  a new block, over and over; an op is one free and one allocation.
+ *  small (32 bytes) comes from the thread caches, medium (2KB) from the
+ *  heap under its mutex, large (64KB) from new_pages(). pool and arena
+ *  are the same pattern with pool_alloc() and arena_alloc() (an arena is
+ *  reset every WINDOW * 64 allocations).
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <malloc.h>
+#include <pool.h>
+#include <arena.h>
+#include "bench.h"
+
+#define BENCH "malloc"
+#define OPS 1000000
+#define LARGE_OPS 20000
+#define WINDOW 16
+
+#define KIND_MALLOC 0
+#define KIND_POOL 1
+#define KIND_ARENA 2
+
+typedef struct {
+    const char *name;
+    int kind;
+    int size;
+    int ops;
+} bench_case_t;
+
+#define CASES 5
+static bench_case_t cases[CASES] = {
+    {"small32", KIND_MALLOC, 32, OPS},
+    {"medium2k", KIND_MALLOC, 2048, OPS},
+    {"large64k", KIND_MALLOC, 64 * 1024, LARGE_OPS},
+    {"pool64", KIND_POOL, 64, OPS * 4},
+    {"arena32", KIND_ARENA, 32, OPS * 10},
+};
+
+static bench_case_t *current;
+static pool_t *pool;
+static int ops_per_thread;
+static int failures;
+
+/** @brief Replace blocks of the current case
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void churn(int id, void *arg)
+{
+    void *blocks[WINDOW] = {NULL};
+    arena_t *arena = NULL;
+    int size = current->size;
+    int i, slot;
+
+    if(current->kind == KIND_ARENA){
+        arena = arena_create(0, ARENA_BIND_THREAD);
+        if(arena == NULL){
+            failures++;
+            return;
+        }
+    }
+
+    for(i = 0; i < ops_per_thread; i++){
+        slot = i % WINDOW;
+        switch(current->kind){
+        case KIND_MALLOC:
+            free(blocks[slot]);
+            blocks[slot] = malloc(size);
+            break;
+        case KIND_POOL:
+            if(blocks[slot] != NULL)
+                pool_free(pool, blocks[slot]);
+            blocks[slot] = pool_alloc(pool);
+            break;
+        default:
+            if(i % (WINDOW * 64) == 0)
+                arena_reset(arena);
+            blocks[slot] = arena_alloc(arena, size);
+            break;
+        }
+        if(blocks[slot] == NULL){
+            failures++;
+            return;
+        }
+        *(int *)blocks[slot] = i;
+    }
+
+    for(slot = 0; slot < WINDOW; slot++){
+        if(current->kind == KIND_MALLOC)
+            free(blocks[slot]);
+        else if(current->kind == KIND_POOL && blocks[slot] != NULL)
+            pool_free(pool, blocks[slot]);
+    }
+    if(arena != NULL)
+        arena_destroy(arena);
+}
+
+int main(int argc, char *argv[])
+{
+    int ops, ticks, n, i, c;
+
+    bench_init(argc, argv);
+
+    if((pool = pool_create(64)) == NULL){
+        printf("BENCH bench=%s error=pool_create\n", BENCH);
+        return -1;
+    }
+
+    for(c = 0; c < CASES; c++){
+        current = &cases[c];
+        ops = bench_ops(current->ops);
+        for(i = 0; i < BENCH_SWEEP; i++){
+            n = bench_sweep[i];
+            ops_per_thread = ops / n;
+            ticks = bench_run(n, churn, NULL);
+            bench_report(BENCH, current->name, n, ops_per_thread * n, ticks);
+        }
+    }
+
+    if(failures != 0)
+        printf("BENCH bench=%s error=out_of_memory\n", BENCH);
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/** @file bench_mutex.c
+ *  @brief Benchmark mutex_lock() and mutex_unlock().
+ *
+ *  private: each thread locks a mutex of its own, so nothing is contended
+ *  and the sweep shows how the fast path scales. contended: all threads
+ *  lock one mutex around a shared counter. The counter is checked.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <mutex.h>
+#include "bench.h"
+
+#define BENCH "mutex"
+#define OPS 2000000
+
+/* a mutex with its own cache line */
+typedef struct {
+    mutex_t mutex;
+    char pad[64 - sizeof(mutex_t) % 64];
+} bench_mutex_t;
+
+static bench_mutex_t mutexes[BENCH_MAX_THREADS];
+static volatile int counter;
+static int ops_per_thread;
+
+/** @brief Lock the mutex of the thread
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void lock_private(int id, void *arg)
+{
+    mutex_t *mp = &mutexes[id].mutex;
+    int i;
+
+    for(i = 0; i < ops_per_thread; i++){
+        mutex_lock(mp);
+        mutex_unlock(mp);
+    }
+}
+
+/** @brief Lock the shared mutex and count
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void lock_shared(int id, void *arg)
+{
+    mutex_t *mp = &mutexes[0].mutex;
+    int i;
+
+    for(i = 0; i < ops_per_thread; i++){
+        mutex_lock(mp);
+        counter++;
+        mutex_unlock(mp);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int ops, ticks, n, i;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    for(i = 0; i < BENCH_MAX_THREADS; i++)
+        mutex_init(&mutexes[i].mutex);
+
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        ops_per_thread = ops / n;
+        ticks = bench_run(n, lock_private, NULL);
+        bench_report(BENCH, "private", n, ops_per_thread * n, ticks);
+    }
+
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        ops_per_thread = ops / n;
+        counter = 0;
+        ticks = bench_run(n, lock_shared, NULL);
+        if(counter != ops_per_thread * n)
+            printf("BENCH bench=%s error=counter\n", BENCH);
+        bench_report(BENCH, "contended", n, ops_per_thread * n, ticks);
+    }
+
+    for(i = 0; i < BENCH_MAX_THREADS; i++)
+        mutex_destroy(&mutexes[i].mutex);
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/** @file bench_rwlock.c
+ *  @brief Benchmark read-mostly locking: rwlock against seqlock.
+ *
+ *  Each thread reads a pair of counters, or with the given odds bumps
+ *  both of them, under a readers/writers lock (rwlock case) or a sequence
+ *  lock (seqlock case). The mixes are 90, 99 and 100 percent reads. A
+ *  reader checks that the two counters agree.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <rwlock.h>
+#include <seqlock.h>
+#include "bench.h"
+
+#define BENCH "rwlock"
+#define OPS 1000000
+
+#define MIXES 3
+static int read_percent[MIXES] = {90, 99, 100};
+
+static rwlock_t rwlock;
+static seqlock_t seqlock;
+static volatile int data_a, data_b;
+
+static int ops_per_thread;
+static int reads;
+static int errors;
+
+/** @brief Next number of a thread's random sequence
+ *
+ *  @param seed state of the sequence
+ *  @return a number from 0 to 99
+ */
+static int next_percent(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) % 100;
+}
+
+/** @brief Read or write under the rwlock
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void use_rwlock(int id, void *arg)
+{
+    unsigned int seed = id + 1;
+    int i;
+
+    for(i = 0; i < ops_per_thread; i++){
+        if(next_percent(&seed) < reads){
+            rwlock_lock(&rwlock, RWLOCK_READ);
+            if(data_a != data_b)
+                errors++;
+            rwlock_unlock(&rwlock);
+        }
+        else {
+            rwlock_lock(&rwlock, RWLOCK_WRITE);
+            data_a++;
+            data_b++;
+            rwlock_unlock(&rwlock);
+        }
+    }
+}
+
+/** @brief Read or write under the seqlock
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void use_seqlock(int id, void *arg)
+{
+    unsigned int seed = id + 1;
+    unsigned int seq;
+    int i, a, b;
+
+    for(i = 0; i < ops_per_thread; i++){
+        if(next_percent(&seed) < reads){
+            do {
+                seq = seqlock_read_begin(&seqlock);
+                a = data_a;
+                b = data_b;
+            } while(seqlock_read_retry(&seqlock, seq));
+            if(a != b)
+                errors++;
+        }
+        else {
+            seqlock_write_begin(&seqlock);
+            data_a++;
+            data_b++;
+            seqlock_write_end(&seqlock);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char name[32];
+    int ops, ticks, n, i, m;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    rwlock_init(&rwlock);
+    seqlock_init(&seqlock);
+
+    for(m = 0; m < MIXES; m++){
+        reads = read_percent[m];
+        for(i = 0; i < BENCH_SWEEP; i++){
+            n = bench_sweep[i];
+            ops_per_thread = ops / n;
+
+            snprintf(name, sizeof(name), "rwlock_read%d", reads);
+            ticks = bench_run(n, use_rwlock, NULL);
+            bench_report(BENCH, name, n, ops_per_thread * n, ticks);
+
+            snprintf(name, sizeof(name), "seqlock_read%d", reads);
+            ticks = bench_run(n, use_seqlock, NULL);
+            bench_report(BENCH, name, n, ops_per_thread * n, ticks);
+        }
+    }
+
+    if(errors != 0)
+        printf("BENCH bench=%s error=torn_read\n", BENCH);
+
+    seqlock_destroy(&seqlock);
+    rwlock_destroy(&rwlock);
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/** @file bench_sem.c
+ *  @brief Benchmark semaphores with producers and consumers.
+ *
+ *  A bounded buffer guarded by two counting semaphores (free and full
+ *  slots) and a mutex. single: each item is one sem_wait() and one
+ *  sem_signal() on each side. batch: items move BATCH at a time with
+ *  sem_wait_n() and sem_signal_n(). The sweep runs n producers and n
+ *  consumers; every item is checked to come out once.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <mutex.h>
+#include <sem.h>
+#include "bench.h"
+
+#define BENCH "sem"
+#define OPS 400000
+#define SLOTS 64
+#define BATCH 8
+
+static sem_t free_slots;
+static sem_t full_slots;
+static mutex_t buf_mutex;
+static int buf[SLOTS];
+static int buf_head, buf_tail;
+
+static int items_per_thread;
+static int batch;
+static unsigned int sums[BENCH_MAX_THREADS];
+
+/** @brief Produce items_per_thread items, batch at a time
+ *
+ *  @param id worker index, producers are even
+ *  @param arg unused
+ *  @return Void
+ */
+static void produce(int id, void *arg)
+{
+    int i, j;
+
+    for(i = 0; i < items_per_thread; i += batch){
+        sem_wait_n(&free_slots, batch);
+        mutex_lock(&buf_mutex);
+        for(j = 0; j < batch; j++){
+            buf[buf_head] = i + j + 1;
+            buf_head = (buf_head + 1) % SLOTS;
+        }
+        mutex_unlock(&buf_mutex);
+        sem_signal_n(&full_slots, batch);
+    }
+}
+
+/** @brief Consume items_per_thread items, batch at a time
+ *
+ *  @param id worker index, consumers are odd
+ *  @param arg unused
+ *  @return Void
+ */
+static void consume(int id, void *arg)
+{
+    unsigned int sum = 0;
+    int i, j;
+
+    for(i = 0; i < items_per_thread; i += batch){
+        sem_wait_n(&full_slots, batch);
+        mutex_lock(&buf_mutex);
+        for(j = 0; j < batch; j++){
+            sum += buf[buf_tail];
+            buf_tail = (buf_tail + 1) % SLOTS;
+        }
+        mutex_unlock(&buf_mutex);
+        sem_signal_n(&free_slots, batch);
+    }
+
+    sums[id] = sum;
+}
+
+static void worker(int id, void *arg)
+{
+    if(id % 2 == 0)
+        produce(id, arg);
+    else
+        consume(id, arg);
+}
+
+/** @brief Run n producers and n consumers
+ *
+ *  @param name name of the case
+ *  @param n number of producers
+ *  @param ops items to move
+ *  @return Void
+ */
+static void run(const char *name, int n, int ops)
+{
+    unsigned int sum = 0, expect, items;
+    int ticks, i;
+
+    items_per_thread = ops / n / batch * batch;
+    sem_init(&free_slots, SLOTS);
+    sem_init(&full_slots, 0);
+    mutex_init(&buf_mutex);
+    buf_head = buf_tail = 0;
+
+    ticks = bench_run(n * 2, worker, NULL);
+
+    /* each producer sends 1 .. items, the sums may wrap around */
+    for(i = 1; i < n * 2; i += 2)
+        sum += sums[i];
+    items = items_per_thread;
+    if(items % 2 == 0)
+        expect = n * (items / 2) * (items + 1);
+    else
+        expect = n * items * ((items + 1) / 2);
+    if(sum != expect)
+        printf("BENCH bench=%s error=sum\n", BENCH);
+
+    bench_report(BENCH, name, n * 2, items_per_thread * n, ticks);
+
+    mutex_destroy(&buf_mutex);
+    sem_destroy(&full_slots);
+    sem_destroy(&free_slots);
+}
+
+int main(int argc, char *argv[])
+{
+    int ops, i;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    batch = 1;
+    for(i = 0; i < BENCH_SWEEP; i++)
+        run("single", bench_sweep[i], ops);
+
+    batch = BATCH;
+    for(i = 0; i < BENCH_SWEEP; i++)
+        run("batch", bench_sweep[i], ops);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/** @file bench_thread.c
+ *  @brief Benchmark thread creation.
+ *
+ *  latency: one thread creates a thread which returns at once, and joins
+ *  it, over and over. churn: several threads do the same at once, so they
+ *  compete for stacks and the registry. start: the time from just before
+ *  thr_create() to the first instruction of the child, summed over the
+ *  children; the ticks of the line are that sum. lookup: threads look
+ *  up the tids of LIVE blocked threads in the registry, as thr_join() and
+ *  the stack fault handler do; an op is one get_thread_by_tid().
+ *
+ *  Built with MALLOC_STATS, each churn case also reports the allocations
+ *  and frees of the library during the run; creating and reaping a thread
+ *  takes none, so they only come from starting the workers.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#define BENCH_ALLOCS
+
+#include <sem.h>
+#include <thr_internals.h>
+#include "bench.h"
+
+#define BENCH "thread"
+#define OPS 20000
+#define LOOKUPS 2000000
+#define LIVE 16
+
+static int ops_per_thread;
+static volatile int started_at;
+static int live_tids[LIVE];
+static sem_t live_sem;
+static int misses;
+
+static void *child(void *arg)
+{
+    return arg;
+}
+
+/** @brief Record when the child got to run
+ *
+ *  @param arg unused
+ *  @return NULL
+ */
+static void *child_start(void *arg)
+{
+    started_at = get_ticks();
+    return NULL;
+}
+
+/** @brief Time from thr_create() to the first instruction of each child
+ *
+ *  @param ops children to create
+ *  @return ticks summed over the children
+ */
+static int start_latency(int ops)
+{
+    int i, tid, before, sum = 0;
+
+    for(i = 0; i < ops; i++){
+        before = get_ticks();
+        tid = thr_create(child_start, NULL);
+        if(tid < 0 || thr_join(tid, NULL) < 0){
+            printf("BENCH bench=%s error=start\n", BENCH);
+            exit(-1);
+        }
+        sum += started_at - before;
+    }
+
+    return sum;
+}
+
+/** @brief Create and join children one at a time
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void create_join(int id, void *arg)
+{
+    int i, tid;
+
+    for(i = 0; i < ops_per_thread; i++){
+        tid = thr_create(child, NULL);
+        if(tid < 0 || thr_join(tid, NULL) < 0){
+            printf("BENCH bench=%s error=create_join\n", BENCH);
+            exit(-1);
+        }
+    }
+}
+
+/** @brief A thread to be looked up, it blocks until the lookups end
+ *
+ *  @param arg unused
+ *  @return NULL
+ */
+static void *live(void *arg)
+{
+    sem_wait(&live_sem);
+    return NULL;
+}
+
+/** @brief Look up the live threads over and over
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void lookup(int id, void *arg)
+{
+    int i, missed = 0;
+
+    for(i = 0; i < ops_per_thread; i++){
+        if(get_thread_by_tid(live_tids[i % LIVE]) == NULL)
+            missed++;
+    }
+    if(missed != 0)
+        atom_add(&misses, missed);
+}
+
+int main(int argc, char *argv[])
+{
+    int ops, ticks, n, i;
+    int allocs, frees, frees_before;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    ops_per_thread = ops;
+    ticks = bench_run(1, create_join, NULL);
+    bench_report(BENCH, "latency", 1, ops, ticks);
+
+    bench_report(BENCH, "start", 1, ops, start_latency(ops));
+
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        ops_per_thread = ops / n;
+        allocs = bench_count_allocs(&frees_before);
+        ticks = bench_run(n, create_join, NULL);
+        bench_report(BENCH, "churn", n, ops_per_thread * n, ticks);
+
+        if(allocs >= 0){
+            allocs = bench_count_allocs(&frees) - allocs;
+            bench_report_allocs(BENCH, "churn_allocs", n, ops_per_thread * n,
+                                allocs, frees - frees_before);
+        }
+    }
+
+    sem_init(&live_sem, 0);
+    for(i = 0; i < LIVE; i++){
+        if((live_tids[i] = thr_create(live, NULL)) < 0){
+            printf("BENCH bench=%s error=thr_create\n", BENCH);
+            return -1;
+        }
+    }
+
+    ops = bench_ops(LOOKUPS);
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        ops_per_thread = ops / n;
+        ticks = bench_run(n, lookup, NULL);
+        bench_report(BENCH, "lookup", n, ops_per_thread * n, ticks);
+    }
+
+    for(i = 0; i < LIVE; i++)
+        sem_signal(&live_sem);
+    for(i = 0; i < LIVE; i++)
+        thr_join(live_tids[i], NULL);
+    sem_destroy(&live_sem);
+
+    if(misses != 0)
+        printf("BENCH bench=%s error=lookup misses=%d\n", BENCH, misses);
+
+    return 0;
+}
@@ -0,0 +1,317 @@
+/** @file bench_tpool.c
+ *  @brief Benchmark task throughput of the thread pool.
+ *
+ *  An op is one task which marks itself done. thr_create runs every task
+ *  on a thread of its own, BATCH threads at a time, as the baseline.
+ *  external submits all tasks from the main thread, so they go through
+ *  the shared queue. recursive starts one task which submits two children
+ *  down to a binary tree of about as many tasks, so workers push to their
+ *  own deques and steal from each other. nested runs small trees of
+ *  NESTED_LEAVES leaves, one after another, whose inner nodes call
+ *  tpool_wait() after they submit their children; when it returns every
+ *  leaf must have run. With more than one worker, each tree comes with a
+ *  task which waits for the root to wait in tpool_wait(), then blocks on
+ *  the future of a child it submits to its own deque; the worker of the
+ *  root has to run the child. Every task is checked to run once.
+ *
+ *  @author Kaili Li (kailili)
+ *  @author Qi Liu (qiliu)
+ *  @bug No known bugs.
+ */
+
+#include <tpool.h>
+#include <future.h>
+#include <thr_internals.h>
+#include "bench.h"
+
+#define BENCH "tpool"
+#define OPS 200000
+#define THREAD_OPS 20000
+#define BATCH 64
+#define NESTED_LEAVES 16
+
+/* marks of the blocking task and of its child, after the tree */
+#define BLOCKER (2 * NESTED_LEAVES)
+
+/* yields of the blocking task to let the root go to sleep */
+#define BLOCKER_YIELDS 10
+
+static tpool_t *pool;
+static char *done;
+static int ntasks;
+static int nleaves;
+static int nrounds;
+static int nnodes;
+static int leaves_done;
+static volatile int root_waiting;
+static int failures;
+
+/** @brief A task, mark it done
+ *
+ *  @param arg index of the task
+ *  @return Void
+ */
+static void task(void *arg)
+{
+    done[(int)arg]++;
+}
+
+/** @brief A thread running one task
+ *
+ *  @param arg index of the task
+ *  @return NULL
+ */
+static void *task_thread(void *arg)
+{
+    task(arg);
+    return NULL;
+}
+
+/** @brief A node of the task tree, submit the children and mark it done
+ *
+ *  Nodes are numbered as in a heap, the children of i are 2i and 2i + 1.
+ *
+ *  @param arg index of the node, from 1
+ *  @return Void
+ */
+static void node(void *arg)
+{
+    int i = (int)arg;
+
+    if(i < nleaves){
+        if(tpool_submit(pool, node, (void *)(2 * i)) < 0 ||
+           tpool_submit(pool, node, (void *)(2 * i + 1)) < 0){
+            printf("BENCH bench=%s error=submit\n", BENCH);
+            exit(-1);
+        }
+    }
+    done[i - 1]++;
+}
+
+/** @brief The child of the blocking task, set its future
+ *
+ *  @param arg the future
+ *  @return Void
+ */
+static void blocker_child(void *arg)
+{
+    done[BLOCKER]++;
+    future_set((future_t *)arg, arg);
+}
+
+/** @brief Submit a child and block on its future
+ *
+ *  The child goes to the deque of this worker, which blocks; another
+ *  worker has to take it, even one waiting in tpool_wait().
+ *
+ *  @param arg unused
+ *  @return Void
+ */
+static void blocker(void *arg)
+{
+    future_t future;
+    int i;
+
+    while(!root_waiting)
+        thr_yield(-1);
+    for(i = 0; i < BLOCKER_YIELDS; i++)
+        thr_yield(-1);
+
+    future_init(&future);
+    if(tpool_submit(pool, blocker_child, &future) < 0){
+        printf("BENCH bench=%s error=submit\n", BENCH);
+        exit(-1);
+    }
+    if(future_get(&future) != &future)
+        atom_add(&failures, 1);
+    future_destroy(&future);
+    done[BLOCKER - 1]++;
+}
+
+/** @brief A node of a small tree, an inner one waits for the tree
+ *
+ *  @param arg index of the node, from 1
+ *  @return Void
+ */
+static void nested_node(void *arg)
+{
+    int i = (int)arg;
+
+    if(i >= NESTED_LEAVES){
+        atom_add(&leaves_done, 1);
+        done[i - 1]++;
+        return;
+    }
+
+    if(tpool_submit(pool, nested_node, (void *)(2 * i)) < 0 ||
+       tpool_submit(pool, nested_node, (void *)(2 * i + 1)) < 0){
+        printf("BENCH bench=%s error=submit\n", BENCH);
+        exit(-1);
+    }
+
+    /* only the inner nodes waiting may be left, the leaves do not wait */
+    if(i == 1)
+        root_waiting = 1;
+    tpool_wait(pool);
+    if(*(volatile int *)&leaves_done != NESTED_LEAVES)
+        atom_add(&failures, 1);
+    done[i - 1]++;
+}
+
+/** @brief Run every task on a thread of its own
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void run_threads(int id, void *arg)
+{
+    int tids[BATCH];
+    int i, j, n;
+
+    for(i = 0; i < ntasks; i += n){
+        n = ntasks - i < BATCH ? ntasks - i : BATCH;
+        for(j = 0; j < n; j++){
+            if((tids[j] = thr_create(task_thread, (void *)(i + j))) < 0){
+                printf("BENCH bench=%s error=thr_create\n", BENCH);
+                exit(-1);
+            }
+        }
+        for(j = 0; j < n; j++)
+            thr_join(tids[j], NULL);
+    }
+}
+
+/** @brief Submit every task from this thread
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void run_external(int id, void *arg)
+{
+    int i;
+
+    for(i = 0; i < ntasks; i++){
+        if(tpool_submit(pool, task, (void *)i) < 0){
+            printf("BENCH bench=%s error=submit\n", BENCH);
+            exit(-1);
+        }
+    }
+    tpool_wait(pool);
+}
+
+/** @brief Submit the root of the task tree
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void run_recursive(int id, void *arg)
+{
+    if(tpool_submit(pool, node, (void *)1) < 0){
+        printf("BENCH bench=%s error=submit\n", BENCH);
+        exit(-1);
+    }
+    tpool_wait(pool);
+}
+
+/** @brief Run the small trees one after another
+ *
+ *  @param id worker index
+ *  @param arg unused
+ *  @return Void
+ */
+static void run_nested(int id, void *arg)
+{
+    int i, j, bad = 0;
+
+    for(i = 0; i < nrounds; i++){
+        leaves_done = 0;
+        root_waiting = 0;
+        if((nnodes > BLOCKER - 1 && tpool_submit(pool, blocker, NULL) < 0) ||
+           tpool_submit(pool, nested_node, (void *)1) < 0){
+            printf("BENCH bench=%s error=submit\n", BENCH);
+            exit(-1);
+        }
+        tpool_wait(pool);
+
+        for(j = 0; j < nnodes; j++){
+            if(done[j] != 1)
+                bad++;
+            done[j] = 0;
+        }
+    }
+    if(bad != 0 || failures != 0)
+        printf("BENCH bench=%s error=nested bad=%d early=%d\n", BENCH, bad,
+               failures);
+}
+
+/** @brief Check every task ran once, and clear the marks
+ *
+ *  @return Void
+ */
+static void check(void)
+{
+    int i, bad = 0;
+
+    for(i = 0; i < ntasks; i++){
+        if(done[i] != 1)
+            bad++;
+        done[i] = 0;
+    }
+    if(bad != 0)
+        printf("BENCH bench=%s error=tasks bad=%d\n", BENCH, bad);
+}
+
+int main(int argc, char *argv[])
+{
+    int ops, ticks, n, i;
+
+    bench_init(argc, argv);
+    ops = bench_ops(OPS);
+
+    /* the tree has 2 * nleaves - 1 nodes, no more than ops */
+    for(nleaves = 1; nleaves * 4 - 1 <= ops; nleaves *= 2)
+        continue;
+
+    if((done = calloc(ops + 1, 1)) == NULL){
+        printf("BENCH bench=%s error=out_of_memory\n", BENCH);
+        return -1;
+    }
+
+    ntasks = bench_ops(THREAD_OPS);
+    ticks = bench_run(1, run_threads, NULL);
+    check();
+    bench_report(BENCH, "thr_create", 1, ntasks, ticks);
+
+    for(i = 0; i < BENCH_SWEEP; i++){
+        n = bench_sweep[i];
+        if((pool = tpool_create(n, 0)) == NULL){
+            printf("BENCH bench=%s error=tpool_create\n", BENCH);
+            return -1;
+        }
+
+        ntasks = ops;
+        ticks = bench_run(1, run_external, NULL);
+        check();
+        bench_report(BENCH, "external", n, ntasks, ticks);
+
+        ntasks = 2 * nleaves - 1;
+        ticks = bench_run(1, run_recursive, NULL);
+        check();
+        bench_report(BENCH, "recursive", n, ntasks, ticks);
+
+        /* a worker blocked on a future needs another one to run the child */
+        nnodes = n > 1 ? BLOCKER + 1 : BLOCKER - 1;
+        nrounds = ops / nnodes;
+        ticks = bench_run(1, run_nested, NULL);
+        bench_report(BENCH, "nested", n, nrounds * nnodes, ticks);
+
+        tpool_destroy(pool);
+    }
+
+    free(done);
+
+    return 0;
+}